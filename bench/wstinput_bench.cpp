@@ -0,0 +1,311 @@
+// Windstille Input Library
+// Copyright (C) 2005-2020 Ingo Ruhnke <grumbel@gmail.com>
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+// License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+// Microbenchmark of the dispatch hot path, feeds synthetic SDL_Event
+// streams through InputBindings and reports ns/event and
+// allocations/event. Runs headless with SDL's dummy video driver.
+
+#include <SDL.h>
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include <logmich/log.hpp>
+
+#include <wstinput/controller.hpp>
+#include <wstinput/controller_description.hpp>
+#include <wstinput/input_bindings.hpp>
+#include <wstinput/input_manager.hpp>
+
+using namespace wstinput;
+
+namespace {
+
+std::atomic<uint64_t> g_allocations{0};
+
+/** Keeps the Controller queries from being optimized away */
+volatile float g_sink = 0.0f;
+
+} // namespace
+
+void* operator new(size_t size)
+{
+  g_allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void* ptr = malloc(size == 0 ? 1 : size)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept
+{
+  free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+  free(ptr);
+}
+
+namespace {
+
+/** Number of events dispatched between two Controller::clear() */
+constexpr size_t g_frame_size = 64;
+
+struct Options
+{
+  size_t events = 1000000;
+  bool batch = false;
+};
+
+enum Scenario
+{
+  KEYBOARD_SCENARIO,
+  MOUSE_MOTION_SCENARIO,
+  JOYSTICK_AXIS_SCENARIO,
+  TEXT_INPUT_SCENARIO
+};
+
+char const* scenario_name(Scenario scenario)
+{
+  switch (scenario)
+  {
+    case KEYBOARD_SCENARIO: return "keyboard";
+    case MOUSE_MOTION_SCENARIO: return "mouse-motion";
+    case JOYSTICK_AXIS_SCENARIO: return "joystick-axis";
+    case TEXT_INPUT_SCENARIO: return "text-input";
+    default: return "unknown";
+  }
+}
+
+/** Scancodes that are valid keys, skipping the reserved ones */
+SDL_Scancode get_scancode(size_t i)
+{
+  return static_cast<SDL_Scancode>(SDL_SCANCODE_A + i % (SDL_SCANCODE_KP_HEXADECIMAL - SDL_SCANCODE_A));
+}
+
+/** Every type gets its own id range, as ids are unique across types:
+    buttons [0, n), axes [n, 2n) and pointers [2n, 3n) */
+int button_id(size_t i) { return static_cast<int>(i); }
+int axis_id(size_t i, size_t bindings) { return static_cast<int>(bindings + i); }
+int pointer_id(size_t i, size_t bindings) { return static_cast<int>(2 * bindings + i); }
+
+ControllerDescription make_description(size_t bindings)
+{
+  ControllerDescription description;
+  for (size_t i = 0; i < bindings; ++i) {
+    description.add_button("button" + std::to_string(i), button_id(i));
+    description.add_axis("axis" + std::to_string(i), axis_id(i, bindings));
+    description.add_pointer("pointer" + std::to_string(i), pointer_id(i, bindings));
+  }
+  return description;
+}
+
+void bind(InputBindings& bindings, size_t count)
+{
+  bindings.clear();
+  for (size_t i = 0; i < count; ++i)
+  {
+    int const n = static_cast<int>(i);
+    bindings.bind_keyboard_button(button_id(i), get_scancode(i));
+    bindings.bind_joystick_button(button_id(i), n / 16, n % 16);
+    bindings.bind_joystick_axis(axis_id(i, count), n / 8, n % 8, false);
+    bindings.bind_mouse_motion(pointer_id(i, count), 0, n % 2);
+  }
+  bindings.compile();
+}
+
+std::vector<SDL_Event> make_events(Scenario scenario, size_t count, size_t bindings)
+{
+  std::vector<SDL_Event> events(count);
+  for (size_t i = 0; i < count; ++i)
+  {
+    SDL_Event& event = events[i];
+    memset(&event, 0, sizeof(event));
+
+    // 1 kHz, the rate of a typical gaming mouse
+    event.common.timestamp = static_cast<Uint32>(i + 1);
+
+    switch (scenario)
+    {
+      case KEYBOARD_SCENARIO:
+        event.type = (i % 2 == 0) ? SDL_KEYDOWN : SDL_KEYUP;
+        event.key.state = (i % 2 == 0) ? SDL_PRESSED : SDL_RELEASED;
+        event.key.keysym.scancode = get_scancode((i / 2) % bindings);
+        break;
+
+      case MOUSE_MOTION_SCENARIO:
+        event.type = SDL_MOUSEMOTION;
+        event.motion.which = 0;
+        event.motion.x = static_cast<Sint32>(i % 1920);
+        event.motion.y = static_cast<Sint32>(i % 1080);
+        event.motion.xrel = 1;
+        event.motion.yrel = 1;
+        break;
+
+      case JOYSTICK_AXIS_SCENARIO: {
+        size_t const axis = i % bindings;
+        event.type = SDL_JOYAXISMOTION;
+        event.jaxis.which = static_cast<SDL_JoystickID>(axis / 8);
+        event.jaxis.axis = static_cast<Uint8>(axis % 8);
+        event.jaxis.value = static_cast<Sint16>((i * 977) % 65536 - 32768);
+        break;
+      }
+
+      case TEXT_INPUT_SCENARIO:
+        event.type = SDL_TEXTINPUT;
+        strcpy(event.text.text, (i % 2 == 0) ? "a" : "\xc3\xa4");
+        break;
+    }
+  }
+  return events;
+}
+
+void run(Options const& options, Scenario scenario, size_t binding_count)
+{
+  ControllerDescription const description = make_description(binding_count);
+  InputManagerSDL manager(description);
+  InputBindings& bindings = manager.bindings();
+  bind(bindings, binding_count);
+
+  if (scenario == TEXT_INPUT_SCENARIO) {
+    manager.start_text_input();
+  }
+
+  Controller controller(description);
+  controller.set_event_capacity(g_frame_size * 2);
+
+  std::vector<SDL_Event> const events = make_events(scenario, options.events, binding_count);
+
+  float checksum = 0.0f;
+  size_t event_count = 0;
+  auto query = [&]{
+    for (size_t i = 0; i < binding_count; ++i) {
+      checksum += controller.get_axis_state(axis_id(i, binding_count));
+      checksum += controller.get_pointer_state(pointer_id(i, binding_count));
+      checksum += controller.get_button_state(button_id(i)) ? 1.0f : 0.0f;
+      checksum += controller.button_was_pressed(button_id(i)) ? 1.0f : 0.0f;
+    }
+    event_count += controller.get_events().size();
+    controller.clear();
+  };
+
+  // warm up, so that buffers have reached their final size
+  for (size_t i = 0; i < std::min(events.size(), g_frame_size * 4); ++i) {
+    bindings.dispatch_event(events[i], controller);
+  }
+  bindings.flush(controller);
+  query();
+
+  uint64_t const allocations = g_allocations.load(std::memory_order_relaxed);
+  auto const start = std::chrono::steady_clock::now();
+
+  for (size_t frame = 0; frame < events.size(); frame += g_frame_size)
+  {
+    size_t const end = std::min(events.size(), frame + g_frame_size);
+    if (options.batch) {
+      bindings.dispatch_events(std::span<SDL_Event const>(events.data() + frame, end - frame), controller);
+    } else {
+      for (size_t i = frame; i < end; ++i) {
+        bindings.dispatch_event(events[i], controller);
+      }
+    }
+    bindings.flush(controller);
+    query();
+  }
+
+  auto const duration = std::chrono::steady_clock::now() - start;
+  uint64_t const allocated = g_allocations.load(std::memory_order_relaxed) - allocations;
+
+  double const ns = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
+  g_sink = checksum;
+
+  // text input changes no state, every other scenario has to, or the
+  // bindings or the Controller are set up wrong and nothing is measured
+  if (event_count == 0 || (scenario != TEXT_INPUT_SCENARIO && checksum == 0.0f)) {
+    std::cerr << scenario_name(scenario) << ": the Controller saw no input, check the setup" << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  printf("%-14s %8zu %12.2f %14.4f\n",
+         scenario_name(scenario), binding_count,
+         ns / static_cast<double>(events.size()),
+         static_cast<double>(allocated) / static_cast<double>(events.size()));
+
+  if (scenario == TEXT_INPUT_SCENARIO) {
+    manager.stop_text_input();
+  }
+}
+
+void print_usage(char const* program)
+{
+  std::cout << "Usage: " << program << " [OPTION]...\n"
+            << "\n"
+            << "  --events N   Number of events per run (default: 1000000)\n"
+            << "  --batch      Use InputBindings::dispatch_events() instead of dispatch_event()\n"
+            << "  --help       Display this help\n";
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+  Options options;
+  for (int i = 1; i < argc; ++i)
+  {
+    if (strcmp(argv[i], "--events") == 0 && i + 1 < argc) {
+      options.events = static_cast<size_t>(strtoull(argv[++i], nullptr, 10));
+    } else if (strcmp(argv[i], "--batch") == 0) {
+      options.batch = true;
+    } else if (strcmp(argv[i], "--help") == 0) {
+      print_usage(argv[0]);
+      return EXIT_SUCCESS;
+    } else {
+      print_usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  // the joystick bindings refer to devices that don't exist, which
+  // would log an error for every one of them
+  logmich::set_log_level(logmich::LogLevel::NONE);
+
+  SDL_SetHint(SDL_HINT_VIDEODRIVER, "dummy");
+  if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_JOYSTICK) != 0) {
+    std::cerr << "SDL_Init() failed: " << SDL_GetError() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  printf("%-14s %8s %12s %14s\n", "scenario", "bindings", "ns/event", "allocs/event");
+  for (Scenario scenario : { KEYBOARD_SCENARIO, MOUSE_MOTION_SCENARIO, JOYSTICK_AXIS_SCENARIO, TEXT_INPUT_SCENARIO }) {
+    for (size_t binding_count : { size_t{10}, size_t{100}, size_t{1000} }) {
+      run(options, scenario, binding_count);
+    }
+  }
+
+  SDL_Quit();
+  return EXIT_SUCCESS;
+}
+
+/* EOF */
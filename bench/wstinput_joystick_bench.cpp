@@ -0,0 +1,315 @@
+// Windstille Input Library
+// Copyright (C) 2005-2020 Ingo Ruhnke <grumbel@gmail.com>
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+// License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+// End-to-end benchmark from SDL_PollEvent() to the Controller state,
+// using SDL virtual joysticks so that no hardware is needed. Reports
+// throughput, the latency from setting a virtual axis or button to
+// the InputEvent showing up, and how many events SDL delivered
+// versus how many the library produced.
+
+#include <SDL.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <wstinput/controller_description.hpp>
+#include <wstinput/input_manager.hpp>
+#include <wstinput/latency_stats.hpp>
+
+using namespace wstinput;
+
+namespace {
+
+struct Options
+{
+  int joysticks = 1;
+  int axes = 6;
+  int buttons = 16;
+
+  /** Changes per second, 0 means as fast as possible */
+  int axis_rate = 1000;
+  int button_rate = 100;
+
+  double duration = 5.0;
+};
+
+struct VirtualJoystick
+{
+  int device_index;
+  SDL_Joystick* joystick;
+
+  /** Id of the first axis, the buttons follow the axes */
+  int first_id;
+};
+
+void print_usage(char const* program)
+{
+  std::cout << "Usage: " << program << " [OPTION]...\n"
+            << "\n"
+            << "  --joysticks N     Number of virtual joysticks (default: 1)\n"
+            << "  --axes N          Axes per joystick (default: 6)\n"
+            << "  --buttons N       Buttons per joystick (default: 16)\n"
+            << "  --axis-rate HZ    Axis changes per second, 0 for unpaced (default: 1000)\n"
+            << "  --button-rate HZ  Button changes per second, 0 for unpaced (default: 100)\n"
+            << "  --duration SEC    Length of the run (default: 5)\n"
+            << "  --help            Display this help\n";
+}
+
+bool parse_args(int argc, char** argv, Options& options)
+{
+  for (int i = 1; i < argc; ++i)
+  {
+    std::string const arg = argv[i];
+    if (arg == "--help") {
+      print_usage(argv[0]);
+      exit(EXIT_SUCCESS);
+    } else if (i + 1 >= argc) {
+      return false;
+    } else if (arg == "--joysticks") {
+      options.joysticks = atoi(argv[++i]);
+    } else if (arg == "--axes") {
+      options.axes = atoi(argv[++i]);
+    } else if (arg == "--buttons") {
+      options.buttons = atoi(argv[++i]);
+    } else if (arg == "--axis-rate") {
+      options.axis_rate = atoi(argv[++i]);
+    } else if (arg == "--button-rate") {
+      options.button_rate = atoi(argv[++i]);
+    } else if (arg == "--duration") {
+      options.duration = atof(argv[++i]);
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+/** Period of \a rate changes per second, zero when unpaced */
+std::chrono::nanoseconds get_period(int rate)
+{
+  return (rate > 0) ? std::chrono::nanoseconds(1000000000 / rate) : std::chrono::nanoseconds(0);
+}
+
+void print_latency(char const* name, LatencyHistogram const& histogram)
+{
+  LatencySummary const summary = histogram.get_summary();
+  printf("%-8s latency: p50=%.3fus p99=%.3fus max=%.3fus\n", name,
+         static_cast<double>(summary.p50) / 1e3,
+         static_cast<double>(summary.p99) / 1e3,
+         static_cast<double>(summary.max) / 1e3);
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+  Options options;
+  if (!parse_args(argc, argv, options)) {
+    print_usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  SDL_SetHint(SDL_HINT_VIDEODRIVER, "dummy");
+  SDL_SetHint(SDL_HINT_JOYSTICK_ALLOW_BACKGROUND_EVENTS, "1");
+  if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_JOYSTICK) != 0) {
+    std::cerr << "SDL_Init() failed: " << SDL_GetError() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  ControllerDescription description;
+  int next_id = 0;
+  for (int j = 0; j < options.joysticks; ++j) {
+    for (int a = 0; a < options.axes; ++a) {
+      description.add_axis("joystick" + std::to_string(j) + "-axis" + std::to_string(a), next_id++);
+    }
+    for (int b = 0; b < options.buttons; ++b) {
+      description.add_button("joystick" + std::to_string(j) + "-button" + std::to_string(b), next_id++);
+    }
+  }
+
+  InputManagerSDL manager(description);
+
+  std::vector<VirtualJoystick> joysticks;
+  next_id = 0;
+  for (int j = 0; j < options.joysticks; ++j)
+  {
+    int const device_index = SDL_JoystickAttachVirtual(SDL_JOYSTICK_TYPE_GAMECONTROLLER,
+                                                       options.axes, options.buttons, 0);
+    if (device_index < 0) {
+      std::cerr << "SDL_JoystickAttachVirtual() failed: " << SDL_GetError() << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    manager.ensure_open_joystick(device_index);
+
+    // the manager holds a reference already, this only gives us the handle
+    SDL_Joystick* joystick = SDL_JoystickOpen(device_index);
+    if (!joystick) {
+      std::cerr << "SDL_JoystickOpen() failed: " << SDL_GetError() << std::endl;
+      return EXIT_FAILURE;
+    }
+    joysticks.push_back(VirtualJoystick{device_index, joystick, next_id});
+
+    int const instance = SDL_JoystickInstanceID(joystick);
+    for (int a = 0; a < options.axes; ++a) {
+      manager.bindings().bind_joystick_axis(next_id++, instance, a, false);
+    }
+    for (int b = 0; b < options.buttons; ++b) {
+      manager.bindings().bind_joystick_button(next_id++, instance, b);
+    }
+  }
+  manager.bindings().compile();
+
+  // drop the device added events
+  SDL_PumpEvents();
+  SDL_FlushEvents(SDL_FIRSTEVENT, SDL_LASTEVENT);
+
+  std::chrono::nanoseconds const axis_period = get_period(options.axis_rate);
+  std::chrono::nanoseconds const button_period = get_period(options.button_rate);
+
+  uint64_t changes = 0;
+  uint64_t sdl_events = 0;
+  uint64_t input_events = 0;
+  uint64_t dispatch_time = 0;
+  LatencyHistogram axis_latency;
+  LatencyHistogram button_latency;
+
+  // when each id was last set, matched against the InputEvent of that
+  // id when the game sees it
+  std::vector<uint64_t> set_times(static_cast<size_t>(next_id), 0);
+  auto record_latency = [&](LatencyHistogram& histogram, int id) {
+    if (static_cast<size_t>(id) >= set_times.size() || set_times[static_cast<size_t>(id)] == 0) {
+      return;
+    }
+    histogram.record(get_input_timestamp() - set_times[static_cast<size_t>(id)]);
+    set_times[static_cast<size_t>(id)] = 0;
+  };
+
+  uint64_t step = 0;
+  bool button_state = false;
+
+  auto const start = std::chrono::steady_clock::now();
+  auto const end = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+    std::chrono::duration<double>(options.duration));
+  auto next_axis = start;
+  auto next_button = start;
+
+  while (true)
+  {
+    auto now = std::chrono::steady_clock::now();
+    if (now >= end) {
+      break;
+    }
+
+    if (now >= next_axis)
+    {
+      step += 1;
+      int const value = static_cast<int>((step * 977) % 65536) - 32768;
+      for (VirtualJoystick const& joystick : joysticks) {
+        for (int a = 0; a < options.axes; ++a) {
+          SDL_JoystickSetVirtualAxis(joystick.joystick, a, static_cast<Sint16>(std::min(value + a, 32767)));
+          set_times[static_cast<size_t>(joystick.first_id + a)] = get_input_timestamp();
+          changes += 1;
+        }
+      }
+      next_axis += axis_period;
+    }
+
+    if (now >= next_button)
+    {
+      button_state = !button_state;
+      for (VirtualJoystick const& joystick : joysticks) {
+        for (int b = 0; b < options.buttons; ++b) {
+          SDL_JoystickSetVirtualButton(joystick.joystick, b, button_state ? SDL_PRESSED : SDL_RELEASED);
+          set_times[static_cast<size_t>(joystick.first_id + options.axes + b)] = get_input_timestamp();
+          changes += 1;
+        }
+      }
+      next_button += button_period;
+    }
+
+    // SDL_PumpEvents() updates the virtual joysticks and queues their events
+    SDL_PumpEvents();
+
+    uint64_t const dispatch_start = get_input_timestamp();
+    SDL_Event event;
+    while (SDL_PollEvent(&event))
+    {
+      if (event.type == SDL_JOYAXISMOTION ||
+          event.type == SDL_JOYBUTTONDOWN ||
+          event.type == SDL_JOYBUTTONUP) {
+        sdl_events += 1;
+      }
+      manager.on_event(event);
+    }
+    manager.update(0.0f);
+
+    uint64_t const consume_time = get_input_timestamp();
+    dispatch_time += consume_time - dispatch_start;
+
+    for (InputEvent const& input_event : manager.get_events())
+    {
+      input_events += 1;
+      if (input_event.type == AXIS_EVENT) {
+        record_latency(axis_latency, input_event.axis.name);
+      } else if (input_event.type == BUTTON_EVENT) {
+        record_latency(button_latency, input_event.button.name);
+      }
+    }
+    manager.clear();
+
+    if (axis_period.count() != 0 && button_period.count() != 0) {
+      std::this_thread::sleep_until(std::min(next_axis, next_button));
+    }
+  }
+
+  double const seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  InputMetrics const metrics = manager.get_metrics();
+
+  printf("duration:          %.3fs\n", seconds);
+  printf("changes set:       %llu\n", static_cast<unsigned long long>(changes));
+  printf("SDL events:        %llu (%.0f/s)\n", static_cast<unsigned long long>(sdl_events),
+         static_cast<double>(sdl_events) / seconds);
+  printf("InputEvents:       %llu (%.0f/s)\n", static_cast<unsigned long long>(input_events),
+         static_cast<double>(input_events) / seconds);
+  printf("bindings matched:  %llu\n", static_cast<unsigned long long>(metrics.bindings.bindings_matched));
+  printf("suppressed:        %llu\n", static_cast<unsigned long long>(metrics.bindings.suppressed_axis_events));
+  printf("dispatch:          %.1fns/event\n",
+         (sdl_events != 0) ? static_cast<double>(dispatch_time) / static_cast<double>(sdl_events) : 0.0);
+  print_latency("axis", axis_latency);
+  print_latency("button", button_latency);
+
+  for (VirtualJoystick const& joystick : joysticks) {
+    SDL_JoystickClose(joystick.joystick);
+  }
+  // device indices shift down when a device goes away, the manager's
+  // handles are closed by SDL_Quit()
+  for (auto it = joysticks.rbegin(); it != joysticks.rend(); ++it) {
+    SDL_JoystickDetachVirtual(it->device_index);
+  }
+
+  SDL_Quit();
+  return EXIT_SUCCESS;
+}
+
+/* EOF */
@@ -0,0 +1,69 @@
+// Windstille Input Library
+// Copyright (C) 2005-2020 Ingo Ruhnke <grumbel@gmail.com>
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+// License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef HEADER_WINDSTILLE_INPUT_AXIS_CURVE_HPP
+#define HEADER_WINDSTILLE_INPUT_AXIS_CURVE_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace wstinput {
+
+/** Describes how a raw joystick axis value is mapped to [-1, 1] */
+struct AxisResponse
+{
+  /** Magnitudes below this are reported as 0 */
+  float deadzone = 0.0f;
+
+  /** Magnitudes above this are reported as 1 */
+  float outer_deadzone = 1.0f;
+
+  /** Applied to the magnitude between the deadzones, values above 1
+      give finer control around the center */
+  float exponent = 1.0f;
+
+  bool invert = false;
+
+  /** Applied last, the result is clamped to [-1, 1] */
+  float scale = 1.0f;
+
+  bool operator==(AxisResponse const&) const = default;
+};
+
+/** An AxisResponse baked into a lookup table covering every possible
+    raw axis value, so that applying it is a single table load */
+class AxisCurve final
+{
+public:
+  AxisCurve(AxisResponse const& response);
+
+  float operator()(int16_t value) const {
+    return static_cast<float>(m_table[static_cast<size_t>(value + 32768)]) * (1.0f / 32767.0f);
+  }
+
+  AxisResponse const& get_response() const { return m_response; }
+
+private:
+  AxisResponse m_response;
+  std::vector<int16_t> m_table;
+};
+
+} // namespace wstinput
+
+#endif
+
+/* EOF */
@@ -0,0 +1,151 @@
+// Windstille Input Library
+// Copyright (C) 2005-2020 Ingo Ruhnke <grumbel@gmail.com>
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+// License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef HEADER_WINDSTILLE_INPUT_BINDING_INDEX_HPP
+#define HEADER_WINDSTILLE_INPUT_BINDING_INDEX_HPP
+
+#include <algorithm>
+#include <span>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+namespace wstinput {
+
+/** Combine a device id and a button/axis number into a BindingIndex key */
+inline uint64_t make_binding_key(int device, int code)
+{
+  return (static_cast<uint64_t>(static_cast<uint32_t>(device)) << 32) |
+    static_cast<uint64_t>(static_cast<uint32_t>(code));
+}
+
+/** Maps a (device, code) key to the list of actions bound to it. Keys
+    are collected with add(), build() then packs all actions with the
+    same key into a contiguous range and indexes the ranges with an
+    open addressing hash table, so that find() costs a single probe in
+    the common case, regardless of how many other keys are bound. */
+template<typename Action>
+class BindingIndex final
+{
+private:
+  struct Slot
+  {
+    uint64_t key;
+
+    /** Range in m_actions, an empty range marks an unused slot */
+    uint32_t begin;
+    uint32_t end;
+  };
+
+public:
+  BindingIndex() :
+    m_staging(),
+    m_slots(),
+    m_actions(),
+    m_shift(64)
+  {}
+
+  void clear()
+  {
+    m_staging.clear();
+    m_slots.clear();
+    m_actions.clear();
+    m_shift = 64;
+  }
+
+  /** Queue \a action for \a key, takes effect on the next build() */
+  void add(uint64_t key, Action const& action)
+  {
+    m_staging.emplace_back(key, action);
+  }
+
+  void build()
+  {
+    std::stable_sort(m_staging.begin(), m_staging.end(),
+                     [](auto const& lhs, auto const& rhs) { return lhs.first < rhs.first; });
+
+    size_t num_keys = 0;
+    for (size_t i = 0; i < m_staging.size(); ++i) {
+      if (i == 0 || m_staging[i].first != m_staging[i - 1].first) {
+        num_keys += 1;
+      }
+    }
+
+    // keep the load factor at or below 0.5
+    int bits = 1;
+    while ((size_t{1} << bits) < num_keys * 2) {
+      bits += 1;
+    }
+    m_shift = 64 - bits;
+
+    m_slots.assign(size_t{1} << bits, Slot{0, 0, 0});
+    m_actions.clear();
+    m_actions.reserve(m_staging.size());
+
+    size_t i = 0;
+    while (i < m_staging.size())
+    {
+      uint64_t const key = m_staging[i].first;
+      uint32_t const begin = static_cast<uint32_t>(m_actions.size());
+      for (; i < m_staging.size() && m_staging[i].first == key; ++i) {
+        m_actions.push_back(m_staging[i].second);
+      }
+
+      Slot& slot = m_slots[probe(key)];
+      slot.key = key;
+      slot.begin = begin;
+      slot.end = static_cast<uint32_t>(m_actions.size());
+    }
+
+    m_staging.clear();
+  }
+
+  std::span<Action const> find(uint64_t key) const
+  {
+    if (m_slots.empty()) {
+      return {};
+    }
+
+    Slot const& slot = m_slots[probe(key)];
+    return std::span<Action const>(m_actions.data() + slot.begin, slot.end - slot.begin);
+  }
+
+  bool empty() const { return m_actions.empty(); }
+
+private:
+  /** Returns the slot holding \a key or the empty slot where it would go */
+  size_t probe(uint64_t key) const
+  {
+    size_t const mask = m_slots.size() - 1;
+    size_t idx = static_cast<size_t>((key * 0x9E3779B97F4A7C15ull) >> m_shift) & mask;
+    while (m_slots[idx].begin != m_slots[idx].end && m_slots[idx].key != key) {
+      idx = (idx + 1) & mask;
+    }
+    return idx;
+  }
+
+private:
+  std::vector<std::pair<uint64_t, Action>> m_staging;
+  std::vector<Slot> m_slots;
+  std::vector<Action> m_actions;
+  int m_shift;
+};
+
+} // namespace wstinput
+
+#endif
+
+/* EOF */
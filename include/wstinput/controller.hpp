@@ -17,70 +17,224 @@
 #ifndef HEADER_WINDSTILLE_INPUT_CONTROLLER_HPP
 #define HEADER_WINDSTILLE_INPUT_CONTROLLER_HPP
 
+#include <array>
+#include <span>
+#include <stdint.h>
+#include <string_view>
 #include <vector>
 
 #include "input_event.hpp"
 
 namespace wstinput {
 
+class ControllerDescription;
+
+struct StickState
+{
+  float x = 0.0f;
+  float y = 0.0f;
+};
+
+/** What Controller does with new events once its event buffer is full */
+enum EventOverflowPolicy
+{
+  /** Discard the new event */
+  OVERFLOW_DROP_NEWEST,
+
+  /** Discard the oldest event of the frame to make room */
+  OVERFLOW_DROP_OLDEST,
+
+  /** Merge the new event into the last event of the same type and
+      name, axis, pointer and stick events keep the new position, ball
+      events add up, other events are discarded */
+  OVERFLOW_COALESCE
+};
+
 /** The Controller class presents the current state of the controller
     and the input events that occurred on the controller since the
     last update */
 class Controller final
 {
-private:
-  union State {
-    enum { BUTTON_STATE, BALL_STATE, AXIS_STATE, POINTER_STATE } type;
-    bool  button;
-    float axis;
-    float ball;
-    float pointer;
-  };
-
 public:
+  /** Reserve state for ids [0, size) of every type */
   Controller(size_t size = 0);
 
+  /** Reserve state for the ids declared in \a description, each
+      type only gets storage up to the largest id of that type */
+  Controller(ControllerDescription const& description);
+
+  /** Limit the number of events kept per frame to \a capacity, the
+      storage for them is allocated up front, so that no allocations
+      happen while dispatching. A capacity of 0, the default, means
+      unlimited. State is always updated, even when an event is
+      discarded. Changing the capacity clear()s the current frame. */
+  void set_event_capacity(size_t capacity, EventOverflowPolicy policy = OVERFLOW_DROP_NEWEST);
+  size_t get_event_capacity() const { return m_event_capacity; }
+
+  /** Number of events that didn't fit into the event buffer */
+  uint64_t get_overflow_count() const { return m_overflow_count; }
+
+  /** Deadzone applied by get_axis_state(), per binding response
+      curves are configured in InputBindings instead */
+  void set_axis_deadzone(float deadzone) { m_axis_deadzone = deadzone; }
+  float get_axis_deadzone() const { return m_axis_deadzone; }
+
+  /** Timestamp given to events added from now on, 0 means to take
+      the current time of get_input_timestamp() for each event */
+  void set_timestamp(uint64_t timestamp) { m_timestamp = timestamp; }
+  uint64_t get_timestamp() const { return m_timestamp; }
+
+  /** Source given to events added from now on */
+  void set_source(InputEventSource source) { m_source = source; }
+  InputEventSource get_source() const { return m_source; }
+
   float get_trigger_state(int name) const;
   float get_axis_state(int name, bool use_deadzone = true) const;
   bool get_button_state(int name) const;
   float get_ball_state(int name) const;
   float get_pointer_state(int name) const;
+  StickState get_stick_state(int name) const;
 
+  /** The events since the last clear(), oldest first. Once
+      OVERFLOW_DROP_OLDEST wrapped around, they are only in order
+      after unwrap_events(), InputManagerSDL does that in update(). */
   InputEventLst const& get_events() const;
 
-  /** Convenience function that searches for a button down event for
-      the given button */
+  /** The \a index-th event in the order get_events() has after
+      unwrap_events(), usable without unwrapping */
+  InputEvent const& get_event(size_t index) const;
+
+  /** Rotate the events of a wrapped around OVERFLOW_DROP_OLDEST
+      buffer back into order, costs O(capacity) when it wrapped and
+      nothing otherwise */
+  void unwrap_events();
+
+  /** Number of events added since the last clear(), including the
+      ones OVERFLOW_DROP_OLDEST overwrote since */
+  uint64_t get_event_count() const { return m_event_count; }
+
+  /** Returns the text of a TEXT_EVENT or TEXT_EDIT_EVENT, only valid
+      until the next clear() */
+  std::string_view get_text(InputEvent const& event) const;
+
+  /** Returns the raw key event of a KEYBOARD_EVENT */
+  SDL_KeyboardEvent get_keyboard_event(InputEvent const& event) const;
+
+  /** The storage get_text() and get_keyboard_event() read from, the
+      offsets in this frame's events point into it */
+  std::string_view get_payload() const { return std::string_view(m_payload.data(), m_payload.size()); }
+
+  /** Returns true if a button down event for the given button
+      occurred since the last clear() */
   bool button_was_pressed(int name) const;
 
-  /** Convenience function that searches for a AxisMove event that
-      pushed the axis up */
+  /** Returns true if a button up event for the given button occurred
+      since the last clear() */
+  bool button_was_released(int name) const;
+
+  /** Returns true if an AxisMove event pushed the axis up since the
+      last clear() */
   bool axis_was_pressed_up(int name) const;
 
-  /** Convenience function that searches for a AxisMove event that
-      pushed the axis down */
+  /** Returns true if an AxisMove event pushed the axis down since the
+      last clear() */
   bool axis_was_pressed_down(int name) const;
 
+  /** Returns the timestamp of the last event that changed the state
+      of the given button, axis, ball, pointer or stick since the last
+      clear(), or 0 if it didn't change */
+  uint64_t get_change_time(InputEventType type, int name) const;
+
   void set_axis_state(int name, float pos);
   void set_button_state(int name, bool down);
   void set_ball_state(int name, float delta);
   void set_pointer_state(int name, float pos);
+  void set_stick_state(int name, float x, float y);
 
   void add_axis_event(int name, float pos);
   void add_ball_event(int name, float pos);
   void add_pointer_event(int name, float pos);
   void add_button_event(int name, bool down);
+  void add_stick_event(int name, float x, float y);
   void add_text_event(int name, std::array<char, 32> const& text);
   void add_text_edit_event(int , std::array<char, 32> const& text, int start, int length);
   void add_keyboard_event(SDL_KeyboardEvent const& key);
 
+  /** Add an event that was produced by another Controller, updating
+      the state as the add_*_event() functions do. \a payload holds
+      the text or SDL_KeyboardEvent for events that carry one. The
+      full time of the event is recovered relative to get_timestamp(),
+      or to the current time when that is 0. */
+  void apply_event(InputEvent const& event, std::string_view payload = {});
+
+  /** Add the events of another Controller's frame, \a payload is that
+      Controller's get_payload(), events that refer to data outside of
+      it are skipped */
+  void apply_events(std::span<InputEvent const> events, std::string_view payload);
+
   void clear();
 
+  /** clear() and set all buttons, axes, balls, pointers and sticks
+      back to zero, the storage is kept */
+  void reset();
+
+  /** Copy state, events and payload of \a other, reuses the already
+      allocated storage, so this is a handful of memcpy()s once the
+      sizes have settled */
+  void assign(Controller const& other);
+
 private:
-  void add_event(const InputEvent& event);
+  /** Stamp \a event and append it, returns the full timestamp the
+      event was given */
+  uint64_t add_event(InputEvent& event);
+  bool coalesce_event(const InputEvent& event);
+
+  /** Copy \a size bytes into m_payload and store their offset in
+      \a offset, fails when the payload capacity is exhausted. With
+      OVERFLOW_DROP_OLDEST every event slot owns a fixed payload slot
+      instead, so that overwriting an event frees its payload. */
+  bool add_payload(void const* data, size_t size, uint32_t& offset);
+
+  void set_change_time(InputEventType type, int name, uint64_t timestamp);
 
 private:
-  std::vector<State> m_states;
+  /** Typed state storage, indexed directly by id, ids outside of the
+      range of a type read as zero and are ignored on write */
+  std::vector<uint64_t>   m_buttons;
+  std::vector<float>      m_axes;
+  std::vector<float>      m_balls;
+  std::vector<float>      m_pointers;
+  std::vector<StickState> m_sticks;
+
+  /** Edges seen since the last clear(), indexed like m_buttons */
+  std::vector<uint64_t> m_buttons_pressed;
+  std::vector<uint64_t> m_buttons_released;
+
+  /** Axes pushed beyond +/-0.5 since the last clear() */
+  std::vector<uint64_t> m_axes_up;
+  std::vector<uint64_t> m_axes_down;
+
+  /** Per type change times for get_change_time(), indexed like the
+      state of that type, text and keyboard events have none */
+  std::array<std::vector<uint64_t>, STICK_EVENT + 1> m_change_times;
+
+  /** Used as a ring starting at m_events_head once OVERFLOW_DROP_OLDEST
+      kicks in, unwrap_events() rotates it back into order */
   InputEventLst m_events;
+  size_t m_events_head;
+  uint64_t m_event_count;
+
+  /** Out of line storage for text and raw keyboard events */
+  std::vector<char> m_payload;
+
+  size_t m_event_capacity;
+  size_t m_payload_capacity;
+  EventOverflowPolicy m_overflow_policy;
+  uint64_t m_overflow_count;
+  uint64_t m_timestamp;
+  InputEventSource m_source;
+
+  float m_axis_deadzone;
 
 public:
   Controller(const Controller&) = delete;
@@ -41,6 +41,7 @@ public:
   void add_axis(const std::string& name, int id);
   void add_ball(const std::string& name, int id);
   void add_pointer(const std::string& name, int id);
+  void add_stick(const std::string& name, int id);
 
   const InputEventDefinition& get_definition(int id) const;
   const InputEventDefinition& get_definition(const std::string& name) const;
@@ -48,6 +49,9 @@ public:
   size_t size() const { return str_to_event.size(); }
   int get_max_id() const;
 
+  /** Returns the largest id of the given type or -1 if there is none */
+  int get_max_id(InputEventType type) const;
+
 private:
   std::map<std::string, InputEventDefinition> str_to_event;
   std::map<int,         InputEventDefinition> id_to_event;
@@ -17,17 +17,42 @@
 #ifndef HEADER_WINDSTILLE_INPUT_INPUT_BINDINGS_HPP
 #define HEADER_WINDSTILLE_INPUT_INPUT_BINDINGS_HPP
 
+#include <array>
+#include <bitset>
 #include <filesystem>
+#include <span>
+#include <stdint.h>
 #include <vector>
 
 #include <SDL.h>
 
+#include "axis_curve.hpp"
+#include "binding_index.hpp"
+#include "input_event.hpp"
+#include "input_metrics.hpp"
+#include "orientation_filter.hpp"
+#include "wiimote_event.hpp"
+
 namespace wstinput {
 
 class Controller;
 class ControllerDescription;
 class InputManagerSDL;
 
+/** How a keyboard axis resolves while both of its keys are held down
+    (simultaneous opposing cardinal directions) */
+enum SOCDPolicy
+{
+  /** The key pressed last decides the direction */
+  SOCD_LAST_WINS,
+
+  /** Opposing keys cancel each other out */
+  SOCD_NEUTRAL,
+
+  /** The key pressed first decides the direction */
+  SOCD_FIRST_WINS
+};
+
 struct JoystickButtonBinding
 {
   int event;
@@ -40,7 +65,11 @@ struct JoystickAxisBinding
   int  event;
   int  device;
   int  axis;
-  bool invert;
+  AxisResponse response;
+
+  /** Changes smaller than this, relative to the last reported value,
+      are dropped, unless the axis reaches its rest or end position */
+  float epsilon;
 };
 
 struct JoystickButtonAxisBinding
@@ -57,6 +86,26 @@ struct JoystickAxisButtonBinding
   int  device;
   int  axis;
   bool up;
+
+  /** The axis has to move further than this to press the button */
+  float deadzone;
+};
+
+/** Pairs two joystick axes into a single 2D stick with a radial
+    deadzone */
+struct JoystickStickBinding
+{
+  int  event;
+  int  device;
+  int  x_axis;
+  int  y_axis;
+  bool invert_x;
+  bool invert_y;
+
+  /** Applied to the length of the (x, y) vector */
+  float deadzone;
+  float outer_deadzone;
+  float exponent;
 };
 
 struct MouseButtonBinding
@@ -118,10 +167,14 @@ public:
 
   void bind_joystick_hat_axis(int event, int device, int axis);
 
-  void bind_joystick_axis(int event, int device, int axis, bool invert);
+  void bind_joystick_axis(int event, int device, int axis, bool invert, float epsilon = 0.0f);
+  void bind_joystick_axis(int event, int device, int axis, AxisResponse const& response, float epsilon = 0.0f);
   void bind_joystick_button_axis(int event, int device, int minus, int plus);
   void bind_joystick_button(int event, int device, int button);
-  void bind_joystick_axis_button(int event, int device, int axis, bool up);
+  void bind_joystick_axis_button(int event, int device, int axis, bool up, float deadzone = 0.0f);
+  void bind_joystick_stick(int event, int device, int x_axis, int y_axis,
+                           bool invert_x = false, bool invert_y = false,
+                           float deadzone = 0.0f, float outer_deadzone = 1.0f, float exponent = 1.0f);
 
   void bind_keyboard_button(int event, SDL_Scancode key);
   void bind_keyboard_axis(int event, SDL_Scancode minus, SDL_Scancode plus);
@@ -136,15 +189,151 @@ public:
 
   void clear();
 
-  void dispatch_event(SDL_Event const& event, Controller& controller) const;
+  void set_socd_policy(SOCDPolicy policy) { m_socd_policy = policy; }
+  SOCDPolicy get_socd_policy() const { return m_socd_policy; }
+
+  /** When enabled mouse motion is not reported per SDL event, instead
+      relative motion is summed up and only the latest absolute
+      position is kept, both are reported by flush() as a single ball
+      or pointer event per binding. Disabled by default. */
+  void set_mouse_motion_coalescing(bool enable) { m_mouse_motion_coalescing = enable; }
+  bool get_mouse_motion_coalescing() const { return m_mouse_motion_coalescing; }
+
+  /** Weight of a new Wiimote accelerometer sample in the orientation
+      filter, 1.0 disables filtering */
+  void set_wiimote_smoothing(float smoothing);
+  float get_wiimote_smoothing() const { return m_wiimote_smoothing; }
+
+  /** Send the events that have been held back for coalescing to the
+      \a controller, InputManagerSDL calls this once per frame. Stick
+      bindings and the Wiimote orientation are always reported from
+      here, so that a movement of both axes results in a single
+      event. */
+  void flush(Controller& controller);
+
+  /** Counters of the events seen since construction. Only safe to
+      call from the thread that dispatches events. */
+  BindingMetrics const& get_metrics() const { return m_metrics; }
+
+  /** Number of joystick axis samples that were not forwarded to the
+      Controller, as they didn't change the axis by more than the
+      bindings epsilon */
+  uint64_t get_suppressed_axis_events() const { return m_metrics.suppressed_axis_events; }
+
+  /** Number of joystick axis samples that were not forwarded to the
+      Controller, as they didn't change the state of an axis-button */
+  uint64_t get_suppressed_axis_button_events() const { return m_metrics.suppressed_axis_button_events; }
+
+  /** Rebuild the lookup tables used by dispatch_event() from the
+      current set of bindings. load() does this automatically, after
+      manual bind_*() calls it is done lazily on the next dispatch. */
+  void compile();
+
+  void dispatch_event(SDL_Event const& event, Controller& controller);
+
+  /** Dispatch a batch of events. The events are grouped by type
+      first and each group is handed to its dispatcher in one go,
+      the order of events is preserved within a group, but not
+      across groups, i.e. keyboard events stay in order relative to
+      each other, but not relative to mouse events. */
+  void dispatch_events(std::span<SDL_Event const> events, Controller& controller);
+
+  /** Route a button, axis or accelerometer event of a Wiimote to the
+      bindings of that device. Accelerometer samples are filtered and
+      reported by flush() as the WIIMOTE_PITCH_AXIS and
+      WIIMOTE_ROLL_AXIS axes. */
+  void dispatch_wiimote_event(WiimoteEvent const& event, Controller& controller);
+
+private:
+  void dispatch_wiimote_axis(int device, int axis, float pos, Controller& controller);
+
+  static EventGroup get_event_group(Uint32 type);
+  static InputEventSource get_event_source(EventGroup group);
+
+  /** Measure m_sdl_ticks_offset again, SDL_GetTicks() and
+      get_input_timestamp() run on clocks that drift apart */
+  void update_sdl_ticks_offset(uint64_t now);
+
+  /** Convert a SDL timestamp in milliseconds to the clock of
+      get_input_timestamp(), never returns a time later than \a now */
+  uint64_t from_sdl_timestamp(Uint32 timestamp, uint64_t now) const;
+
+  uint32_t get_axis_curve(AxisResponse const& response);
+
+  void dispatch_keyboard_event(SDL_Event const& event, bool text_input_active, Controller& controller);
+  void dispatch_key_event(SDL_KeyboardEvent const& key, Controller& controller);
+  void dispatch_mouse_button_event(SDL_MouseButtonEvent const& button, Controller& controller);
+  void dispatch_mouse_motion_event(SDL_MouseMotionEvent const& motion, Controller& controller);
+  void dispatch_mouse_wheel_event(SDL_MouseWheelEvent const& wheel, Controller& controller);
+  void dispatch_joy_button_event(SDL_JoyButtonEvent const& button, Controller& controller);
+  void dispatch_joy_axis_event(SDL_JoyAxisEvent const& button, Controller& controller);
+
+private:
+  /** Compiled form of the joystick bindings, indexed by (device, axis) */
+  struct JoystickAxisAction
+  {
+    enum Type { AXIS, AXIS_BUTTON, STICK_X, STICK_Y } type;
+    int event;
+
+    /** up for AXIS_BUTTON, unused otherwise */
+    bool flag;
+
+    /** Index into m_joystick_axis_filters, or m_joystick_sticks for
+        STICK_X and STICK_Y */
+    uint32_t filter;
+
+    /** Index into m_axis_curves */
+    uint32_t curve;
+  };
+
+  /** Current and last reported position of a joystick stick binding */
+  struct JoystickStickState
+  {
+    float x;
+    float y;
+    float last_x;
+    float last_y;
+    bool  pending;
+
+    /** Timestamp of the last sample */
+    uint64_t timestamp;
+  };
+
+  /** Last value reported for a joystick axis binding */
+  struct JoystickAxisFilter
+  {
+    float epsilon;
+    float last;
+  };
+
+  /** Compiled form of the joystick bindings, indexed by (device, button) */
+  struct JoystickButtonAction
+  {
+    enum Type { BUTTON, AXIS_MINUS, AXIS_PLUS } type;
+    int event;
+  };
 
 private:
-  void dispatch_key_event(SDL_KeyboardEvent const& key, Controller& controller) const;
-  void dispatch_mouse_button_event(SDL_MouseButtonEvent const& button, Controller& controller) const;
-  void dispatch_mouse_motion_event(SDL_MouseMotionEvent const& motion, Controller& controller) const;
-  void dispatch_mouse_wheel_event(SDL_MouseWheelEvent const& wheel, Controller& controller) const;
-  void dispatch_joy_button_event(SDL_JoyButtonEvent const& button, Controller& controller) const;
-  void dispatch_joy_axis_event(SDL_JoyAxisEvent const& button, Controller& controller) const;
+  /** Compiled form of the keyboard bindings, one entry per binding
+      that a given scancode triggers */
+  struct KeyboardAction
+  {
+    enum Type { BUTTON, AXIS_MINUS, AXIS_PLUS } type;
+    int event;
+
+    /** The opposing key of an axis binding */
+    SDL_Scancode other;
+  };
+
+  /** Motion accumulated for a single mouse binding while coalescing */
+  struct PendingMotion
+  {
+    float value;
+    bool  pending;
+
+    /** Timestamp of the last sample */
+    uint64_t timestamp;
+  };
 
 private:
   InputManagerSDL& m_manager;
@@ -153,6 +342,7 @@ private:
   std::vector<JoystickButtonAxisBinding> m_joystick_button_axis_bindings;
   std::vector<JoystickAxisBinding>       m_joystick_axis_bindings;
   std::vector<JoystickAxisButtonBinding> m_joystick_axis_button_bindings;
+  std::vector<JoystickStickBinding>      m_joystick_stick_bindings;
 
   std::vector<KeyboardButtonBinding> m_keyboard_button_bindings;
   std::vector<KeyboardAxisBinding>   m_keyboard_axis_bindings;
@@ -164,6 +354,57 @@ private:
   std::vector<WiimoteButtonBinding> m_wiimote_button_bindings;
   std::vector<WiimoteAxisBinding>   m_wiimote_axis_bindings;
 
+  SOCDPolicy m_socd_policy;
+
+  /** Keys that are held down according to the events dispatched so
+      far, this can lag behind SDL_GetKeyboardState() when events are
+      processed in batches, but is consistent with the event order */
+  std::bitset<SDL_NUM_SCANCODES> m_key_state;
+
+  bool m_mouse_motion_coalescing;
+
+  /** Parallel to m_mouse_motion_bindings and m_mouse_motion_ball_bindings */
+  std::vector<PendingMotion> m_pending_pointer_motion;
+  std::vector<PendingMotion> m_pending_ball_motion;
+
+  /** true when the bindings changed since the last compile() */
+  bool m_dirty;
+
+  /** The actions for scancode N are stored in
+      m_keyboard_actions[m_keyboard_offsets[N], m_keyboard_offsets[N+1]) */
+  std::array<uint32_t, SDL_NUM_SCANCODES + 1> m_keyboard_offsets;
+  std::vector<KeyboardAction> m_keyboard_actions;
+
+  BindingIndex<JoystickAxisAction>   m_joystick_axis_index;
+  BindingIndex<JoystickButtonAction> m_joystick_button_index;
+
+  /** Event ids of the Wiimote bindings, indexed by (device, button)
+      and (device, axis) */
+  BindingIndex<int> m_wiimote_button_index;
+  BindingIndex<int> m_wiimote_axis_index;
+
+  float m_wiimote_smoothing;
+
+  /** Indexed by Wiimote device id, grows as devices show up */
+  std::vector<OrientationFilter> m_wiimote_orientation;
+
+  std::vector<JoystickAxisFilter>    m_joystick_axis_filters;
+
+  /** Parallel to m_joystick_stick_bindings */
+  std::vector<JoystickStickState>    m_joystick_sticks;
+
+  /** Lookup tables shared by all bindings with the same response */
+  std::vector<AxisCurve> m_axis_curves;
+
+  BindingMetrics m_metrics;
+
+  /** get_input_timestamp() at SDL_GetTicks() == 0, measured at the
+      start of every dispatch_event() and dispatch_events() */
+  uint64_t m_sdl_ticks_offset;
+
+  /** Scratch space for dispatch_events() */
+  std::vector<SDL_Event const*> m_event_groups;
+
 private:
   InputBindings(const InputBindings&) = delete;
   InputBindings& operator=(const InputBindings&) = delete;
@@ -18,13 +18,16 @@
 #define HEADER_WINDSTILLE_INPUT_INPUT_EVENT_HPP
 
 #include <array>
+#include <chrono>
+#include <stddef.h>
+#include <stdint.h>
 #include <vector>
 
 #include <SDL.h>
 
 namespace wstinput {
 
-enum InputEventType
+enum InputEventType : uint8_t
 {
   BUTTON_EVENT,
   AXIS_EVENT,
@@ -32,26 +35,44 @@ enum InputEventType
   POINTER_EVENT,
   TEXT_EVENT,
   TEXT_EDIT_EVENT,
-  KEYBOARD_EVENT
+  KEYBOARD_EVENT,
+  STICK_EVENT
 };
 
-/** Used for textual input */
+/** The kind of device an InputEvent originated from */
+enum InputEventSource : uint8_t
+{
+  OTHER_SOURCE,
+  KEYBOARD_SOURCE,
+  MOUSE_SOURCE,
+  JOYSTICK_SOURCE,
+  WIIMOTE_SOURCE,
+  NUM_INPUT_EVENT_SOURCES
+};
+
+/** Used for textual input, the text itself is stored out of line,
+    use Controller::get_text() to access it */
 struct TextEvent
 {
-  std::array<char, 32> text;
+  uint32_t offset;
+  uint32_t size;
 };
 
+/** The cursor position and selection are clamped to [0, 255], SDL's
+    edit text never gets that long */
 struct TextEditEvent
 {
-  std::array<char, 32> text;
-  int start;
-  int length;
+  uint32_t offset;
+  uint16_t size;
+  uint8_t  start;
+  uint8_t  length;
 };
 
-/** Raw keyboard events, only send when text input is active */
+/** Raw keyboard events, only send when text input is active, use
+    Controller::get_keyboard_event() to access the SDL_KeyboardEvent */
 struct KeyboardEvent
 {
-  SDL_KeyboardEvent key;
+  uint32_t offset;
 };
 
 struct ButtonEvent
@@ -89,9 +110,27 @@ struct AxisEvent
   float get_pos() const { return pos; }
 };
 
+/** Both axes of an analog stick, reported together, the positions are
+    stored as fixed point with the resolution of an SDL joystick axis */
+struct StickEvent
+{
+  int     name;
+  int16_t x;
+  int16_t y;
+
+  float get_x() const { return static_cast<float>(x) / 32767.0f; }
+  float get_y() const { return static_cast<float>(y) / 32767.0f; }
+};
+
 struct InputEvent
 {
   InputEventType type;
+  InputEventSource source;
+
+  /** Time the event happened as the lower 32 bits of
+      get_input_timestamp() in microseconds, this wraps around every 71
+      minutes, from_event_timestamp() recovers the full time */
+  uint32_t timestamp;
 
   union
   {
@@ -101,9 +140,65 @@ struct InputEvent
     struct TextEditEvent text_edit;
     struct KeyboardEvent keyboard;
     struct BallEvent ball;
+    struct StickEvent stick;
   };
 };
 
+static_assert(sizeof(InputEvent) <= 16, "InputEvent should stay compact");
+
+/** Monotonic clock used for InputEvent::timestamp, in nanoseconds */
+inline uint64_t get_input_timestamp()
+{
+  return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                 std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+/** Reduce a get_input_timestamp() value to an InputEvent::timestamp */
+inline uint32_t to_event_timestamp(uint64_t timestamp)
+{
+  return static_cast<uint32_t>(timestamp / 1000);
+}
+
+/** The get_input_timestamp() value of an InputEvent::timestamp,
+    \a reference is any time within 35 minutes of the event, such as
+    the current time or the start of the frame */
+inline uint64_t from_event_timestamp(uint32_t timestamp, uint64_t reference)
+{
+  int32_t const delta = static_cast<int32_t>(timestamp - to_event_timestamp(reference));
+  return static_cast<uint64_t>(static_cast<int64_t>(reference / 1000) + delta) * 1000;
+}
+
+/** The part of a frame's payload that \a event refers to, empty for
+    events without payload. Returns false when it doesn't fit into
+    \a payload_size bytes, e.g. in a corrupt recording. */
+inline bool get_payload_range(InputEvent const& event, size_t payload_size, size_t& offset, size_t& size)
+{
+  switch (event.type)
+  {
+    case TEXT_EVENT:
+      offset = event.text.offset;
+      size = event.text.size;
+      break;
+
+    case TEXT_EDIT_EVENT:
+      offset = event.text_edit.offset;
+      size = event.text_edit.size;
+      break;
+
+    case KEYBOARD_EVENT:
+      offset = event.keyboard.offset;
+      size = sizeof(SDL_KeyboardEvent);
+      break;
+
+    default:
+      offset = 0;
+      size = 0;
+      break;
+  }
+
+  return offset <= payload_size && size <= payload_size - offset;
+}
+
 using InputEventLst = std::vector<InputEvent>;
 
 } // namespace wstinput
@@ -18,18 +18,29 @@
 #define HEADER_WINDSTILLE_INPUT_INPUT_MANAGER_HPP
 
 #include <SDL.h>
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <filesystem>
 #include <memory>
+#include <span>
+#include <thread>
 
 #include <prio/fwd.hpp>
 
 #include "controller.hpp"
 #include "controller_description.hpp"
 #include "input_bindings.hpp"
+#include "input_metrics.hpp"
+#include "latency_stats.hpp"
+#include "spsc_queue.hpp"
+#include "triple_buffer.hpp"
 
 namespace wstinput {
 
 class InputManagerSDLImpl;
+class InputRecorder;
+class WiimoteManager;
 
 class InputManagerSDL
 {
@@ -51,22 +62,150 @@ public:
 
   InputBindings& bindings() { return m_bindings; }
 
+  /** Returns this frame's events, the same as
+      get_controller().get_events(), but marks them as consumed for
+      the latency statistics */
+  InputEventLst const& get_events();
+
+  /** Latency histograms, nullptr unless the library is built with
+      WSTINPUT_LATENCY_STATS */
+  LatencyStats* latency_stats() { return m_latency_stats.get(); }
+
+  /** Log the latency statistics every \a interval from update(), an
+      interval of zero disables the report */
+  void set_latency_report_interval(std::chrono::milliseconds interval);
+
+  /** Snapshot of the pipeline counters, call it from the main thread */
+  InputMetrics get_metrics();
+
+  /** Append every frame to \a filename from now on, a frame ends with
+      clear(). Use InputReplay to play the recording back. */
+  void start_recording(std::filesystem::path const& filename);
+  void stop_recording();
+  bool is_recording() const { return m_recorder != nullptr; }
+
+  /** Make a copy of the current controller state and this frame's
+      events available to acquire_snapshot(). Call this from the
+      thread that dispatches events, once per frame before clear(). */
+  void publish_snapshot();
+
+  /** Returns the last published snapshot. This never blocks and can be
+      called from another thread than the one dispatching events, but
+      only from a single one. The returned Controller stays unchanged
+      until the next call. If more than one frame was published since
+      the last call, only the latest frame's events are visible. */
+  Controller const& acquire_snapshot();
+
   void on_event(const SDL_Event& event);
 
+  /** Dispatch a batch of events, see InputBindings::dispatch_events() */
+  void dispatch_events(std::span<SDL_Event const> events);
+
+  /** Drain all keyboard, mouse and joystick events from the SDL
+      event queue and dispatch them in batches. All other events,
+      e.g. SDL_QUIT or window events, are left in the queue for the
+      application to handle. */
+  void pump();
+
+  /** Move event dispatch to a separate thread that polls joysticks
+      and drains the SDL event queue \a rate times per second. The
+      resulting events are passed to the main thread through a queue
+      of \a queue_capacity entries and show up in the Controller on
+      the next update(), which also takes over SDL_PumpEvents(). While
+      the thread runs the application must leave keyboard, mouse and
+      joystick events in the SDL queue and must not change the
+      bindings. When the queue is full the thread waits for update()
+      rather than dropping events. */
+  void start_input_thread(int rate = 1000, size_t queue_capacity = 4096);
+  void stop_input_thread();
+  bool is_input_thread_running() const { return m_input_thread.joinable(); }
+
   /** Ensure that the joystick device \a device is open */
   void ensure_open_joystick(int device);
 
+  /** Connect to another Wiimote, this blocks until the Wiimote is
+      found or the search times out, press 1+2 on the Wiimote to make
+      it discoverable. Returns the device id to use in the bindings or
+      -1 on failure. */
+  int connect_wiimote();
+
+  /** Must not be called while the input thread is running */
+  void disconnect_wiimotes();
+
   void start_text_input();
   void stop_text_input();
   bool is_text_input_active() const;
 
+private:
+  /** An event on its way from the input thread to the main thread,
+      together with the text or keyboard data it refers to */
+  struct QueuedInputEvent
+  {
+    InputEvent event;
+    uint32_t payload_size;
+    std::array<char, sizeof(SDL_KeyboardEvent)> payload;
+  };
+
+  /** Dispatch the input events from the SDL queue to \a controller */
+  void drain_events(Controller& controller);
+  void poll_wiimote(Controller& controller, DispatchMetrics& metrics);
+  void input_thread_main(std::chrono::nanoseconds period);
+  static QueuedInputEvent make_queued_event(Controller const& controller, InputEvent const& event);
+
+  /** Account for the events added to \a controller after its
+      get_event_count() was \a first, that were dispatched since
+      \a start */
+  void record_dispatch(Controller const& controller, uint64_t first, uint64_t start, DispatchMetrics& metrics);
+  void report_latency();
+
 private:
   ControllerDescription m_controller_description;
   Controller m_controller;
   InputBindings m_bindings;
+  TripleBuffer<Controller> m_snapshots;
   std::vector<SDL_Joystick*> m_joysticks;
   std::map<std::string, SDL_Scancode> m_keyidmapping;
 
+  std::thread m_input_thread;
+  std::atomic<bool> m_input_thread_running;
+  std::unique_ptr<SPSCQueue<QueuedInputEvent>> m_input_queue;
+
+  /** Collects the events dispatched on the input thread */
+  std::unique_ptr<Controller> m_thread_controller;
+
+  /** Index of the first event of m_thread_controller that the input
+      thread couldn't queue before it was stopped */
+  size_t m_thread_unsent;
+
+  /** Only allocated with WSTINPUT_LATENCY_STATS, the histograms take
+      up several KB */
+  std::unique_ptr<LatencyStats> m_latency_stats;
+
+  /** get_event_count() of m_controller at the last get_events() */
+  uint64_t m_consumed_events;
+
+  std::chrono::steady_clock::duration m_latency_report_interval;
+  std::chrono::steady_clock::time_point m_latency_report_time;
+
+  /** Counters of dispatch on the main thread */
+  DispatchMetrics m_dispatch_metrics;
+
+  /** Counters of dispatch on the input thread, only accessed by the
+      main thread while the input thread isn't running */
+  DispatchMetrics m_thread_dispatch_metrics;
+
+  /** Published by the input thread for get_metrics() */
+  TripleBuffer<InputMetrics> m_thread_metrics;
+
+  uint64_t m_frames;
+  uint64_t m_update_time;
+
+  std::unique_ptr<InputRecorder> m_recorder;
+
+#ifdef HAVE_CWIID
+  std::unique_ptr<WiimoteManager> m_wiimotes;
+#endif
+
 private:
   InputManagerSDL (const InputManagerSDL&);
   InputManagerSDL& operator= (const InputManagerSDL&);
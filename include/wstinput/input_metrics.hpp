@@ -0,0 +1,114 @@
+// Windstille Input Library
+// Copyright (C) 2005-2020 Ingo Ruhnke <grumbel@gmail.com>
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+// License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef HEADER_WINDSTILLE_INPUT_INPUT_METRICS_HPP
+#define HEADER_WINDSTILLE_INPUT_INPUT_METRICS_HPP
+
+#include <array>
+#include <stdint.h>
+
+namespace wstinput {
+
+/** Categories of SDL events, InputBindings dispatches them in this order */
+enum EventGroup : uint8_t
+{
+  KEYBOARD_GROUP,
+  MOUSE_MOTION_GROUP,
+  MOUSE_BUTTON_GROUP,
+  JOY_AXIS_GROUP,
+  JOY_BUTTON_GROUP,
+  OTHER_GROUP,
+  NUM_EVENT_GROUPS
+};
+
+/** Counters kept by InputBindings */
+struct BindingMetrics
+{
+  /** SDL events received, per EventGroup */
+  std::array<uint64_t, NUM_EVENT_GROUPS> sdl_events = {};
+
+  /** SDL events that no binding could apply to, e.g. window events */
+  uint64_t ignored_events = 0;
+
+  /** Bindings triggered by an SDL event, an event can match several */
+  uint64_t bindings_matched = 0;
+
+  /** Joystick axis samples that didn't change the axis by more than
+      the bindings epsilon */
+  uint64_t suppressed_axis_events = 0;
+
+  /** Joystick axis samples that didn't change an axis-button */
+  uint64_t suppressed_axis_button_events = 0;
+};
+
+/** Counters kept by whichever thread dispatches events */
+struct DispatchMetrics
+{
+  /** InputEvents produced */
+  uint64_t input_events = 0;
+
+  /** Wiimote messages received, per WiimoteEvent type */
+  uint64_t wiimote_button_events = 0;
+  uint64_t wiimote_axis_events = 0;
+  uint64_t wiimote_acc_events = 0;
+
+  /** Polls of the Wiimote that returned events and the largest
+      number of events drained at once */
+  uint64_t wiimote_pops = 0;
+  uint64_t wiimote_max_pop_size = 0;
+
+  /** Nanoseconds spent dispatching events */
+  uint64_t dispatch_time = 0;
+
+  DispatchMetrics& operator+=(DispatchMetrics const& other)
+  {
+    input_events += other.input_events;
+    wiimote_button_events += other.wiimote_button_events;
+    wiimote_axis_events += other.wiimote_axis_events;
+    wiimote_acc_events += other.wiimote_acc_events;
+    wiimote_pops += other.wiimote_pops;
+    wiimote_max_pop_size = (wiimote_max_pop_size > other.wiimote_max_pop_size) ?
+      wiimote_max_pop_size : other.wiimote_max_pop_size;
+    dispatch_time += other.dispatch_time;
+    return *this;
+  }
+};
+
+/** Snapshot of the input pipeline counters of InputManagerSDL. All
+    counters are totals since startup, subtract the previous snapshot
+    to get per frame values. */
+struct InputMetrics
+{
+  BindingMetrics bindings;
+  DispatchMetrics dispatch;
+
+  /** Number of update() calls */
+  uint64_t frames = 0;
+
+  /** Nanoseconds spent in update() */
+  uint64_t update_time = 0;
+
+  /** Events that didn't fit into the Controller's event buffer, plus
+      the times the input thread found its queue full and had to wait
+      for the main thread */
+  uint64_t overflow_events = 0;
+};
+
+} // namespace wstinput
+
+#endif
+
+/* EOF */
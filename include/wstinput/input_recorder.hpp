@@ -0,0 +1,97 @@
+// Windstille Input Library
+// Copyright (C) 2005-2020 Ingo Ruhnke <grumbel@gmail.com>
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+// License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef HEADER_WINDSTILLE_INPUT_INPUT_RECORDER_HPP
+#define HEADER_WINDSTILLE_INPUT_INPUT_RECORDER_HPP
+
+#include <filesystem>
+#include <fstream>
+#include <stdint.h>
+#include <vector>
+
+#include "input_event.hpp"
+
+namespace wstinput {
+
+class Controller;
+
+/** A recording starts with a RecordingHeader, followed by one frame
+    per Controller::clear(). A frame is a RecordingFrameHeader, the
+    frame's InputEvents and its payload, padded to a multiple of eight
+    bytes, so that every frame can be used in place from a mmap()ed
+    file. All values are stored in native byte order. */
+struct RecordingHeader
+{
+  char     magic[8];
+  uint32_t version;
+
+  /** sizeof(InputEvent) of the recording program */
+  uint32_t event_size;
+};
+
+struct RecordingFrameHeader
+{
+  /** The Controller's get_timestamp() when set, otherwise
+      get_input_timestamp() at the end of the frame */
+  uint64_t timestamp;
+
+  uint32_t event_count;
+  uint32_t payload_size;
+};
+
+/** Frames start at multiples of this, so that both the frame header
+    and the events can be used in place */
+constexpr size_t g_recording_alignment = alignof(RecordingFrameHeader);
+
+static_assert(g_recording_alignment % alignof(InputEvent) == 0);
+static_assert(sizeof(RecordingHeader) % g_recording_alignment == 0);
+static_assert(sizeof(RecordingFrameHeader) % g_recording_alignment == 0);
+
+constexpr char g_recording_magic[8] = { 'W', 'S', 'T', 'I', 'N', 'R', 'E', 'C' };
+constexpr uint32_t g_recording_version = 2;
+
+/** Appends the frames of a Controller to a recording */
+class InputRecorder final
+{
+public:
+  InputRecorder(std::filesystem::path const& filename);
+
+  /** Append the current events of \a controller as one frame, in
+      the order of get_events(), so Controller::unwrap_events() should
+      come first. Throws std::runtime_error when writing fails. */
+  void record_frame(Controller const& controller);
+
+  /** Throws std::runtime_error when writing fails */
+  void flush();
+
+  uint64_t get_frame_count() const { return m_frame_count; }
+
+private:
+  /** Buffer of the output stream, writes reach the file in large chunks */
+  std::vector<char> m_buffer;
+  std::ofstream m_out;
+  uint64_t m_frame_count;
+
+public:
+  InputRecorder(const InputRecorder&) = delete;
+  InputRecorder& operator=(const InputRecorder&) = delete;
+};
+
+} // namespace wstinput
+
+#endif
+
+/* EOF */
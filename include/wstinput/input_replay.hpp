@@ -0,0 +1,79 @@
+// Windstille Input Library
+// Copyright (C) 2005-2020 Ingo Ruhnke <grumbel@gmail.com>
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+// License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef HEADER_WINDSTILLE_INPUT_INPUT_REPLAY_HPP
+#define HEADER_WINDSTILLE_INPUT_INPUT_REPLAY_HPP
+
+#include <filesystem>
+#include <span>
+#include <stddef.h>
+#include <stdint.h>
+#include <string_view>
+
+#include "input_event.hpp"
+
+namespace wstinput {
+
+class Controller;
+
+/** A single frame of a recording, the events and payload point
+    directly into the mapped file */
+struct RecordedFrame
+{
+  uint64_t timestamp = 0;
+  std::span<InputEvent const> events = {};
+  std::string_view payload = {};
+};
+
+/** Plays back a recording made by InputRecorder. The file is mapped
+    into memory, frames are handed out in place, so reading a frame
+    neither copies nor allocates. A frame cut short at the end of the
+    file, e.g. by a crash during recording, ends the replay, as does a
+    frame with events that refer to data outside of its payload. */
+class InputReplay final
+{
+public:
+  InputReplay(std::filesystem::path const& filename);
+  ~InputReplay();
+
+  /** Read the next frame, returns false at the end of the recording */
+  bool read_frame(RecordedFrame& frame);
+
+  /** Replace the events of \a controller with the next frame and
+      update its state accordingly, returns false at the end of the
+      recording */
+  bool replay_frame(Controller& controller);
+
+  /** Start over from the first frame */
+  void rewind();
+
+private:
+  void const* m_data;
+  size_t m_size;
+
+  /** Offset of the next frame */
+  size_t m_pos;
+
+public:
+  InputReplay(const InputReplay&) = delete;
+  InputReplay& operator=(const InputReplay&) = delete;
+};
+
+} // namespace wstinput
+
+#endif
+
+/* EOF */
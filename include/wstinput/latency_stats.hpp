@@ -0,0 +1,132 @@
+// Windstille Input Library
+// Copyright (C) 2005-2020 Ingo Ruhnke <grumbel@gmail.com>
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+// License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef HEADER_WINDSTILLE_INPUT_LATENCY_STATS_HPP
+#define HEADER_WINDSTILLE_INPUT_LATENCY_STATS_HPP
+
+#include <array>
+#include <atomic>
+#include <stdint.h>
+#include <string>
+
+#include "input_event.hpp"
+
+namespace wstinput {
+
+/** Percentiles of a LatencyHistogram, all values in nanoseconds */
+struct LatencySummary
+{
+  uint64_t count = 0;
+  uint64_t p50 = 0;
+  uint64_t p99 = 0;
+  uint64_t max = 0;
+};
+
+/** Lock-free histogram of latencies in nanoseconds. Buckets are
+    logarithmic with four sub-buckets per power of two, so reported
+    percentiles are within 25% of the real value. record() can be
+    called from any number of threads. */
+class LatencyHistogram final
+{
+public:
+  LatencyHistogram();
+
+  void record(uint64_t nanoseconds)
+  {
+    m_buckets[bucket_index(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+
+    uint64_t max = m_max.load(std::memory_order_relaxed);
+    while (nanoseconds > max &&
+           !m_max.compare_exchange_weak(max, nanoseconds, std::memory_order_relaxed)) {}
+  }
+
+  /** The upper bound of the bucket holding the \a fraction quantile,
+      e.g. 0.99 for p99 */
+  uint64_t get_percentile(double fraction) const;
+  uint64_t get_max() const { return m_max.load(std::memory_order_relaxed); }
+  uint64_t get_count() const;
+  LatencySummary get_summary() const;
+
+  void reset();
+
+private:
+  static constexpr int g_sub_bits = 2;
+  static constexpr size_t g_num_buckets = 160;
+
+  static size_t bucket_index(uint64_t value);
+  static uint64_t bucket_upper_bound(size_t index);
+
+private:
+  std::array<std::atomic<uint64_t>, g_num_buckets> m_buckets;
+  std::atomic<uint64_t> m_max;
+
+public:
+  LatencyHistogram(const LatencyHistogram&) = delete;
+  LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+};
+
+/** The stages of the input pipeline that latency is measured to,
+    both measured from the time the OS reported the event */
+enum LatencyStage
+{
+  /** The InputEvent was produced from the SDL event */
+  DISPATCH_LATENCY,
+
+  /** The game fetched the InputEvent via InputManagerSDL::get_events() */
+  CONSUME_LATENCY,
+
+  NUM_LATENCY_STAGES
+};
+
+/** Latency histograms per event source and pipeline stage. Recording
+    compiles to nothing unless WSTINPUT_LATENCY_STATS is defined. */
+class LatencyStats final
+{
+public:
+  LatencyStats();
+
+  void record([[maybe_unused]] LatencyStage stage,
+              [[maybe_unused]] InputEvent const& event,
+              [[maybe_unused]] uint64_t now)
+  {
+#ifdef WSTINPUT_LATENCY_STATS
+    uint64_t const time = from_event_timestamp(event.timestamp, now);
+    m_histograms[stage][event.source].record(now > time ? now - time : 0);
+#endif
+  }
+
+  LatencyHistogram const& get_histogram(LatencyStage stage, InputEventSource source) const {
+    return m_histograms[stage][source];
+  }
+
+  /** One line per source and stage that has samples */
+  std::string to_string() const;
+
+  void reset();
+
+private:
+  std::array<std::array<LatencyHistogram, NUM_INPUT_EVENT_SOURCES>, NUM_LATENCY_STAGES> m_histograms;
+
+public:
+  LatencyStats(const LatencyStats&) = delete;
+  LatencyStats& operator=(const LatencyStats&) = delete;
+};
+
+} // namespace wstinput
+
+#endif
+
+/* EOF */
@@ -0,0 +1,76 @@
+// Windstille Input Library
+// Copyright (C) 2005-2020 Ingo Ruhnke <grumbel@gmail.com>
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+// License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef HEADER_WINDSTILLE_INPUT_ORIENTATION_FILTER_HPP
+#define HEADER_WINDSTILLE_INPUT_ORIENTATION_FILTER_HPP
+
+#include <stdint.h>
+
+namespace wstinput {
+
+/** atan2() with a maximum error below 1e-5 radians, branch free
+    apart from the zero check so it can be vectorized */
+float fast_atan2(float y, float x);
+
+/** Pitch and roll of a Wiimote, derived from the direction of gravity
+    in its accelerometer samples. The samples are low-pass filtered as
+    they arrive, the angles are only computed once per frame by
+    update(). */
+class OrientationFilter final
+{
+public:
+  /** \a smoothing is the weight of a new sample, 1.0 disables the
+      filter, at the 100Hz report rate of the Wiimote 0.2 gives a
+      time constant of about 50ms */
+  OrientationFilter(float smoothing = 0.2f);
+
+  void set_smoothing(float smoothing) { m_smoothing = smoothing; }
+  float get_smoothing() const { return m_smoothing; }
+
+  void add_sample(float x, float y, float z, uint64_t timestamp);
+
+  /** true when samples arrived since the last update() */
+  bool is_pending() const { return m_pending; }
+
+  /** Timestamp of the last sample */
+  uint64_t get_timestamp() const { return m_timestamp; }
+
+  /** Compute \a pitch and \a roll in radians from the filtered
+      samples and clear the pending state */
+  void update(float& pitch, float& roll);
+
+  void reset();
+
+private:
+  float m_smoothing;
+
+  /** Filtered direction of gravity */
+  float m_x;
+  float m_y;
+  float m_z;
+
+  /** false until the first sample, which is taken unfiltered */
+  bool m_valid;
+  bool m_pending;
+  uint64_t m_timestamp;
+};
+
+} // namespace wstinput
+
+#endif
+
+/* EOF */
@@ -0,0 +1,82 @@
+// Windstille Input Library
+// Copyright (C) 2005-2020 Ingo Ruhnke <grumbel@gmail.com>
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+// License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef HEADER_WINDSTILLE_INPUT_REPLAY_ENGINE_HPP
+#define HEADER_WINDSTILLE_INPUT_REPLAY_ENGINE_HPP
+
+#include <filesystem>
+#include <functional>
+#include <span>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "controller_description.hpp"
+
+namespace wstinput {
+
+class Controller;
+
+struct ReplayStats
+{
+  uint64_t sessions = 0;
+
+  /** Sessions that couldn't be opened */
+  uint64_t failed = 0;
+
+  uint64_t frames = 0;
+  uint64_t events = 0;
+  double seconds = 0.0;
+
+  double get_sessions_per_second() const {
+    return (seconds > 0.0) ? static_cast<double>(sessions) / seconds : 0.0;
+  }
+};
+
+/** Replays many recordings in parallel without SDL. Every worker
+    thread owns its own Controller, which is reset between sessions,
+    so sessions don't share any state. */
+class ReplayEngine final
+{
+public:
+  /** Called for every replayed frame on the worker thread that
+      replays \a session, the index into the list passed to run() */
+  using FrameCallback = std::function<void (size_t session, Controller const& controller)>;
+
+  /** \a threads of 0 uses one thread per core */
+  ReplayEngine(ControllerDescription const& description, size_t threads = 0);
+
+  void set_frame_callback(FrameCallback callback) { m_frame_callback = std::move(callback); }
+
+  size_t get_thread_count() const { return m_thread_count; }
+
+  /** Replay all \a sessions and block until they are done */
+  ReplayStats run(std::span<std::filesystem::path const> sessions);
+
+private:
+  ControllerDescription m_description;
+  size_t m_thread_count;
+  FrameCallback m_frame_callback;
+
+public:
+  ReplayEngine(const ReplayEngine&) = delete;
+  ReplayEngine& operator=(const ReplayEngine&) = delete;
+};
+
+} // namespace wstinput
+
+#endif
+
+/* EOF */
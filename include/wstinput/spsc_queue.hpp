@@ -0,0 +1,103 @@
+// Windstille Input Library
+// Copyright (C) 2005-2020 Ingo Ruhnke <grumbel@gmail.com>
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+// License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef HEADER_WINDSTILLE_INPUT_SPSC_QUEUE_HPP
+#define HEADER_WINDSTILLE_INPUT_SPSC_QUEUE_HPP
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace wstinput {
+
+/** Fixed size, lock-free ring buffer for exactly one producer and one
+    consumer thread. All storage is allocated in the constructor, when
+    the queue is full push() fails and counts the value as overflow. */
+template<typename T>
+class SPSCQueue final
+{
+public:
+  /** \a capacity is rounded up to the next power of two */
+  SPSCQueue(size_t capacity) :
+    m_buffer(round_up(capacity)),
+    m_mask(m_buffer.size() - 1),
+    m_head(0),
+    m_tail(0),
+    m_overflow_count(0)
+  {}
+
+  /** Producer side */
+  bool push(T const& value)
+  {
+    size_t const tail = m_tail.load(std::memory_order_relaxed);
+    if (tail - m_head.load(std::memory_order_acquire) == m_buffer.size()) {
+      m_overflow_count.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+
+    m_buffer[tail & m_mask] = value;
+    m_tail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  /** Consumer side */
+  bool pop(T& value)
+  {
+    size_t const head = m_head.load(std::memory_order_relaxed);
+    if (head == m_tail.load(std::memory_order_acquire)) {
+      return false;
+    }
+
+    value = m_buffer[head & m_mask];
+    m_head.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  size_t capacity() const { return m_buffer.size(); }
+
+  /** Number of values rejected by push() because the queue was full */
+  uint64_t get_overflow_count() const { return m_overflow_count.load(std::memory_order_relaxed); }
+
+private:
+  static size_t round_up(size_t capacity)
+  {
+    size_t result = 1;
+    while (result < capacity) {
+      result *= 2;
+    }
+    return result;
+  }
+
+private:
+  std::vector<T> m_buffer;
+  size_t const m_mask;
+
+  // consumer and producer index on separate cache lines
+  alignas(64) std::atomic<size_t> m_head;
+  alignas(64) std::atomic<size_t> m_tail;
+  alignas(64) std::atomic<uint64_t> m_overflow_count;
+
+public:
+  SPSCQueue(const SPSCQueue&) = delete;
+  SPSCQueue& operator=(const SPSCQueue&) = delete;
+};
+
+} // namespace wstinput
+
+#endif
+
+/* EOF */
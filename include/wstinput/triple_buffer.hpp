@@ -0,0 +1,88 @@
+// Windstille Input Library
+// Copyright (C) 2005-2020 Ingo Ruhnke <grumbel@gmail.com>
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+// License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef HEADER_WINDSTILLE_INPUT_TRIPLE_BUFFER_HPP
+#define HEADER_WINDSTILLE_INPUT_TRIPLE_BUFFER_HPP
+
+#include <array>
+#include <atomic>
+#include <stdint.h>
+
+namespace wstinput {
+
+/** Lock-free hand over of values from a single producer thread to a
+    single consumer thread. The producer fills back() and publish()es
+    it, the consumer calls acquire() to get the latest published
+    value, neither side ever waits for the other. Values the consumer
+    didn't pick up in time are overwritten by newer ones. */
+template<typename T>
+class TripleBuffer final
+{
+private:
+  static constexpr uint8_t FRESH = 0x4;
+  static constexpr uint8_t INDEX_MASK = 0x3;
+
+public:
+  template<typename... Args>
+  TripleBuffer(Args const&... args) :
+    m_buffers{T(args...), T(args...), T(args...)},
+    m_back(0),
+    m_middle(1),
+    m_front(2)
+  {}
+
+  /** Producer side: the buffer to fill for the next publish() */
+  T& back() { return m_buffers[m_back]; }
+
+  /** Producer side: make back() available to the consumer */
+  void publish()
+  {
+    uint8_t const prev = m_middle.exchange(static_cast<uint8_t>(m_back | FRESH), std::memory_order_acq_rel);
+    m_back = prev & INDEX_MASK;
+  }
+
+  /** Consumer side: switch front() to the latest published buffer,
+      returns false if nothing new was published */
+  bool acquire()
+  {
+    if (!(m_middle.load(std::memory_order_relaxed) & FRESH)) {
+      return false;
+    }
+
+    uint8_t const prev = m_middle.exchange(m_front, std::memory_order_acq_rel);
+    m_front = prev & INDEX_MASK;
+    return true;
+  }
+
+  /** Consumer side: the buffer returned by the last acquire() */
+  T const& front() const { return m_buffers[m_front]; }
+
+private:
+  std::array<T, 3> m_buffers;
+  uint8_t m_back;
+  std::atomic<uint8_t> m_middle;
+  uint8_t m_front;
+
+public:
+  TripleBuffer(const TripleBuffer&) = delete;
+  TripleBuffer& operator=(const TripleBuffer&) = delete;
+};
+
+} // namespace wstinput
+
+#endif
+
+/* EOF */
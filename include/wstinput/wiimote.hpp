@@ -19,42 +19,13 @@
 
 #ifdef HAVE_CWIID
 
-#include <vector>
-#include <pthread.h>
+#include <atomic>
 #include <cwiid.h>
 
-struct WiimoteButtonEvent
-{
-  int  device;
-  int  button;
-  bool down;
-};
-
-struct WiimoteAxisEvent
-{
-  int   device;
-  int   axis;
-  float pos;
-};
+#include "spsc_queue.hpp"
+#include "wiimote_event.hpp"
 
-struct WiimoteAccEvent
-{
-  int   device;
-  int   accelerometer;
-  float x;
-  float y;
-  float z;
-};
-
-struct WiimoteEvent
-{
-  enum { WIIMOTE_AXIS_EVENT, WIIMOTE_ACC_EVENT, WIIMOTE_BUTTON_EVENT } type;
-  union {
-    WiimoteAxisEvent   axis;
-    WiimoteButtonEvent button;
-    WiimoteAccEvent    acc;
-  };
-};
+namespace wstinput {
 
 struct AccCalibration
 {
@@ -63,18 +34,20 @@ struct AccCalibration
   uint8_t z;
 };
 
-/** */
+/** A single connection to a Wiimote, created by WiimoteManager */
 class Wiimote
 {
 public:
   static void err_callback(cwiid_wiimote_t*, const char *s, va_list ap);
   static void mesg_callback(cwiid_wiimote_t*, int mesg_count, union cwiid_mesg mesg[], timespec*);
 
-  static void init();
-  static void deinit();
-
 private:
-  pthread_mutex_t  mutex;
+  /** Device id stamped into all events of this Wiimote */
+  int              m_device;
+
+  /** Bit (1 << m_device) is set after events were pushed */
+  std::atomic<uint32_t>& m_pending;
+
   cwiid_wiimote_t* m_wiimote;
   bool             m_rumble;
   unsigned char    m_led_state;
@@ -89,16 +62,19 @@ private:
   AccCalibration nunchuk_zero;
   AccCalibration nunchuk_one;
 
-  std::vector<WiimoteEvent> events;
+  /** Filled by the cwiid callback thread, drained by pop_event() */
+  SPSCQueue<WiimoteEvent> m_events;
 
-  void add_button_event(int device, int button, bool down);
-  void add_axis_event(int device, int axis, float pos);
-  void add_acc_event(int device, int accelerometer, float x, float y, float z);
+  void add_button_event(int button, bool down);
+  void add_axis_event(int axis, float pos);
+  void add_acc_event(int accelerometer, float x, float y, float z);
 
 public:
-  Wiimote();
+  Wiimote(int device, std::atomic<uint32_t>& pending);
   ~Wiimote();
 
+  /** Connect to the first Wiimote in discoverable mode, blocks until
+      one is found or the search times out */
   void connect();
   void disconnect();
 
@@ -109,9 +85,15 @@ public:
   void set_rumble(bool t);
   bool get_rumble() const { return m_rumble; }
 
-  std::vector<WiimoteEvent> pop_events();
+  /** Take the oldest event received from the Wiimote, returns false
+      when there is none. Call this from a single thread only. */
+  bool pop_event(WiimoteEvent& event) { return m_events.pop(event); }
+
+  /** Number of events dropped because the game didn't keep up */
+  uint64_t get_overflow_count() const { return m_events.get_overflow_count(); }
 
   bool is_connected() const { return m_wiimote != 0; }
+  int get_device() const { return m_device; }
 
   // Callback functions
   void on_status(const cwiid_status_mesg& msg);
@@ -123,13 +105,14 @@ public:
   void on_classic(const cwiid_classic_mesg& msg);
 
   void mesg(cwiid_wiimote_t*, int mesg_count, union cwiid_mesg mesg[]);
-  void err(cwiid_wiimote_t*, const char *s, va_list ap);
 
 private:
   Wiimote(const Wiimote&);
   Wiimote& operator=(const Wiimote&);
 };
 
+} // namespace wstinput
+
 #endif // HAVE_CWIID
 
 #endif
@@ -0,0 +1,69 @@
+// Windstille Input Library
+// Copyright (C) 2005-2020 Ingo Ruhnke <grumbel@gmail.com>
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+// License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef HEADER_WINDSTILLE_INPUT_WIIMOTE_EVENT_HPP
+#define HEADER_WINDSTILLE_INPUT_WIIMOTE_EVENT_HPP
+
+namespace wstinput {
+
+/** Wiimote axes, 0 and 1 are the Nunchuk stick, pitch and roll are
+    derived from the Wiimote's accelerometer */
+enum WiimoteAxis
+{
+  WIIMOTE_NUNCHUK_X_AXIS = 0,
+  WIIMOTE_NUNCHUK_Y_AXIS = 1,
+  WIIMOTE_PITCH_AXIS = 2,
+  WIIMOTE_ROLL_AXIS = 3
+};
+
+struct WiimoteButtonEvent
+{
+  int  device;
+  int  button;
+  bool down;
+};
+
+struct WiimoteAxisEvent
+{
+  int   device;
+  int   axis;
+  float pos;
+};
+
+struct WiimoteAccEvent
+{
+  int   device;
+  int   accelerometer;
+  float x;
+  float y;
+  float z;
+};
+
+struct WiimoteEvent
+{
+  enum { WIIMOTE_AXIS_EVENT, WIIMOTE_ACC_EVENT, WIIMOTE_BUTTON_EVENT } type;
+  union {
+    WiimoteAxisEvent   axis;
+    WiimoteButtonEvent button;
+    WiimoteAccEvent    acc;
+  };
+};
+
+} // namespace wstinput
+
+#endif
+
+/* EOF */
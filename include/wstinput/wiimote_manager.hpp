@@ -0,0 +1,104 @@
+// Windstille Input Library
+// Copyright (C) 2005-2020 Ingo Ruhnke <grumbel@gmail.com>
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+// License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef HEADER_WINDSTILLE_INPUT_WIIMOTE_MANAGER_HPP
+#define HEADER_WINDSTILLE_INPUT_WIIMOTE_MANAGER_HPP
+
+#ifdef HAVE_CWIID
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <memory>
+
+#include "wiimote.hpp"
+
+namespace wstinput {
+
+/** Holds the connections to all Wiimotes, the index of a Wiimote is
+    the device id used in its events and in the wiimote-button and
+    wiimote-axis bindings */
+class WiimoteManager
+{
+public:
+  /** A Bluetooth piconet can't hold more devices than this */
+  static constexpr int max_wiimotes = 7;
+
+public:
+  WiimoteManager();
+  ~WiimoteManager();
+
+  /** Connect to the next Wiimote in discoverable mode and light up
+      the LED of its player number, returns the device id or -1 when
+      no Wiimote could be connected */
+  int connect();
+
+  /** Disconnect all Wiimotes, must not be called while another thread
+      is in drain() */
+  void disconnect();
+
+  int get_count() const;
+
+  /** Returns the Wiimote with the given device id or nullptr */
+  Wiimote* get_wiimote(int device) const;
+
+  /** Pass every event received since the last call to \a func and
+      return their number. Only the queues of Wiimotes that reported
+      something are looked at, so the cost is proportional to the
+      number of messages that arrived. Call this from a single thread
+      only. */
+  template<typename Func>
+  uint64_t drain(Func&& func)
+  {
+    uint64_t count = 0;
+    uint32_t pending = m_pending.exchange(0, std::memory_order_acquire);
+    while (pending != 0)
+    {
+      int const device = std::countr_zero(pending);
+      pending &= pending - 1;
+
+      WiimoteEvent event;
+      while (m_wiimotes[static_cast<size_t>(device)]->pop_event(event)) {
+        func(event);
+        count += 1;
+      }
+    }
+    return count;
+  }
+
+  /** Number of events dropped by all Wiimotes */
+  uint64_t get_overflow_count() const;
+
+private:
+  std::array<std::unique_ptr<Wiimote>, max_wiimotes> m_wiimotes;
+
+  /** Bit n is set by the cwiid thread of Wiimote n after it pushed
+      events */
+  std::atomic<uint32_t> m_pending;
+
+private:
+  WiimoteManager(const WiimoteManager&) = delete;
+  WiimoteManager& operator=(const WiimoteManager&) = delete;
+};
+
+} // namespace wstinput
+
+#endif // HAVE_CWIID
+
+#endif
+
+/* EOF */
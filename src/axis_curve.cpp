@@ -0,0 +1,58 @@
+// Windstille Input Library
+// Copyright (C) 2005-2020 Ingo Ruhnke <grumbel@gmail.com>
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+// License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#include "axis_curve.hpp"
+
+#include <algorithm>
+#include <math.h>
+
+namespace wstinput {
+
+AxisCurve::AxisCurve(AxisResponse const& response) :
+  m_response(response),
+  m_table(65536)
+{
+  float const inner = std::clamp(response.deadzone, 0.0f, 1.0f);
+  float const outer = std::clamp(response.outer_deadzone, inner, 1.0f);
+
+  for (int raw = -32768; raw <= 32767; ++raw)
+  {
+    // map both ends of the asymmetric int16 range to exactly -1 and 1
+    float const value = (raw < 0) ? static_cast<float>(raw) / 32768.0f : static_cast<float>(raw) / 32767.0f;
+    float const magnitude = fabsf(value);
+
+    float out;
+    if (magnitude <= inner || raw == 0) {
+      out = 0.0f;
+    } else if (magnitude >= outer) {
+      out = 1.0f;
+    } else {
+      out = powf((magnitude - inner) / (outer - inner), response.exponent);
+    }
+
+    out *= response.scale;
+    if ((value < 0.0f) != response.invert) {
+      out = -out;
+    }
+
+    out = std::clamp(out, -1.0f, 1.0f);
+    m_table[static_cast<size_t>(raw + 32768)] = static_cast<int16_t>(lroundf(out * 32767.0f));
+  }
+}
+
+} // namespace wstinput
+
+/* EOF */
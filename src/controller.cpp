@@ -16,21 +16,125 @@
 
 #include "controller.hpp"
 
+#include <algorithm>
 #include <math.h>
-#include <assert.h>
+#include <string.h>
+
+#include "controller_description.hpp"
 
 namespace wstinput {
 
+namespace {
+
+/** Payload bytes reserved per event, enough for a raw keyboard event
+    or the text of a text event */
+constexpr size_t g_payload_slot_size = std::max(sizeof(SDL_KeyboardEvent), sizeof(std::array<char, 32>));
+
+/** Returns the payload offset of \a event or nullptr when it has no
+    payload */
+uint32_t* payload_offset(InputEvent& event)
+{
+  switch (event.type)
+  {
+    case TEXT_EVENT: return &event.text.offset;
+    case TEXT_EDIT_EVENT: return &event.text_edit.offset;
+    case KEYBOARD_EVENT: return &event.keyboard.offset;
+    default: return nullptr;
+  }
+}
+
+int16_t to_fixed(float pos)
+{
+  return static_cast<int16_t>(lroundf(std::clamp(pos, -1.0f, 1.0f) * 32767.0f));
+}
+
+bool test_bit(std::vector<uint64_t> const& bits, int id)
+{
+  size_t const idx = static_cast<size_t>(id);
+  if (idx / 64 >= bits.size()) { return false; }
+
+  return (bits[idx / 64] >> (idx % 64)) & 1u;
+}
+
+void set_bit(std::vector<uint64_t>& bits, int id, bool value)
+{
+  size_t const idx = static_cast<size_t>(id);
+  if (idx / 64 >= bits.size()) { return; }
+
+  uint64_t const mask = uint64_t{1} << (idx % 64);
+  if (value) {
+    bits[idx / 64] |= mask;
+  } else {
+    bits[idx / 64] &= ~mask;
+  }
+}
+
+} // namespace
+
 Controller::Controller(size_t size) :
-  m_states(size),
-  m_events() // FIXME: need to mark states with type
+  m_buttons((size + 63) / 64),
+  m_axes(size),
+  m_balls(size),
+  m_pointers(size),
+  m_sticks(size),
+  m_buttons_pressed(m_buttons.size()),
+  m_buttons_released(m_buttons.size()),
+  m_axes_up((m_axes.size() + 63) / 64),
+  m_axes_down((m_axes.size() + 63) / 64),
+  m_change_times(),
+  m_events(),
+  m_events_head(0),
+  m_event_count(0),
+  m_payload(),
+  m_event_capacity(0),
+  m_payload_capacity(0),
+  m_overflow_policy(OVERFLOW_DROP_NEWEST),
+  m_overflow_count(0),
+  m_timestamp(0),
+  m_source(OTHER_SOURCE),
+  m_axis_deadzone(0.25f)
+{
+  m_change_times[BUTTON_EVENT].resize(m_buttons.size() * 64);
+  m_change_times[AXIS_EVENT].resize(m_axes.size());
+  m_change_times[BALL_EVENT].resize(m_balls.size());
+  m_change_times[POINTER_EVENT].resize(m_pointers.size());
+  m_change_times[STICK_EVENT].resize(m_sticks.size());
+}
+
+Controller::Controller(ControllerDescription const& description) :
+  m_buttons(static_cast<size_t>(description.get_max_id(BUTTON_EVENT) + 1 + 63) / 64),
+  m_axes(static_cast<size_t>(description.get_max_id(AXIS_EVENT) + 1)),
+  m_balls(static_cast<size_t>(description.get_max_id(BALL_EVENT) + 1)),
+  m_pointers(static_cast<size_t>(description.get_max_id(POINTER_EVENT) + 1)),
+  m_sticks(static_cast<size_t>(description.get_max_id(STICK_EVENT) + 1)),
+  m_buttons_pressed(m_buttons.size()),
+  m_buttons_released(m_buttons.size()),
+  m_axes_up((m_axes.size() + 63) / 64),
+  m_axes_down((m_axes.size() + 63) / 64),
+  m_change_times(),
+  m_events(),
+  m_events_head(0),
+  m_event_count(0),
+  m_payload(),
+  m_event_capacity(0),
+  m_payload_capacity(0),
+  m_overflow_policy(OVERFLOW_DROP_NEWEST),
+  m_overflow_count(0),
+  m_timestamp(0),
+  m_source(OTHER_SOURCE),
+  m_axis_deadzone(0.25f)
 {
+  m_change_times[BUTTON_EVENT].resize(m_buttons.size() * 64);
+  m_change_times[AXIS_EVENT].resize(m_axes.size());
+  m_change_times[BALL_EVENT].resize(m_balls.size());
+  m_change_times[POINTER_EVENT].resize(m_pointers.size());
+  m_change_times[STICK_EVENT].resize(m_sticks.size());
 }
 
 float
 Controller::get_trigger_state(int name) const
 {
-  if (m_states.empty()) { return 0.0f; }
+  if (m_axes.empty()) { return 0.0f; }
 
   float value = get_axis_state(name)/2.0f + 0.5f;
   if (value < 0.001f)
@@ -50,48 +154,37 @@ Controller::get_trigger_state(int name) const
 float
 Controller::get_axis_state(int id, bool use_deadzone) const
 {
-  if (m_states.empty()) { return 0.0f; }
+  if (static_cast<size_t>(id) >= m_axes.size()) { return 0.0f; }
 
-  assert(id < int(m_states.size()));
-
-  if (use_deadzone)
+  float const pos = m_axes[static_cast<size_t>(id)];
+  if (use_deadzone && fabsf(pos) <= m_axis_deadzone)
   {
-    if (fabsf(m_states[id].axis) > 0.25f) // FIXME: Hardcoded Deadzone
-      return m_states[id].axis;
-    else
-      return 0.0f;
+    return 0.0f;
   }
   else
   {
-    return m_states[id].axis;
+    return pos;
   }
 }
 
 bool
 Controller::get_button_state(int id) const
 {
-  if (m_states.empty()) { return false; }
-
-  assert(id < int(m_states.size()));
-  return m_states[id].button;
+  return test_bit(m_buttons, id);
 }
 
 void
 Controller::set_axis_state(int id, float pos)
 {
-  if (m_states.empty()) { return; }
+  if (static_cast<size_t>(id) >= m_axes.size()) { return; }
 
-  assert(id < static_cast<int>(m_states.size()));
-  m_states[id].axis = pos;
+  m_axes[static_cast<size_t>(id)] = pos;
 }
 
 void
-Controller::set_button_state(int name, bool down)
+Controller::set_button_state(int id, bool down)
 {
-  if (m_states.empty()) { return; }
-
-  assert(name < static_cast<int>(m_states.size()));
-  m_states[name].button = down;
+  set_bit(m_buttons, id, down);
 }
 
 const InputEventLst&
@@ -100,112 +193,364 @@ Controller::get_events() const
   return m_events;
 }
 
-bool
-Controller::button_was_pressed(int name) const
+InputEvent const&
+Controller::get_event(size_t index) const
 {
-  for(InputEventLst::const_iterator i = m_events.begin(); i != m_events.end(); ++i)
-  {
-    if (i->type == BUTTON_EVENT && i->button.name == name && i->button.down)
-    {
-      return true;
+  return m_events[(m_events_head + index) % m_events.size()];
+}
+
+void
+Controller::unwrap_events()
+{
+  if (m_events_head == 0) {
+    return;
+  }
+
+  // undo the wrap around of OVERFLOW_DROP_OLDEST in place, so this
+  // costs O(capacity) once per frame instead of once per event, the
+  // payload slots move along with their events
+  std::rotate(m_events.begin(), m_events.begin() + static_cast<std::ptrdiff_t>(m_events_head), m_events.end());
+
+  m_payload.resize(m_events.size() * g_payload_slot_size);
+  std::rotate(m_payload.begin(), m_payload.begin() + static_cast<std::ptrdiff_t>(m_events_head * g_payload_slot_size),
+              m_payload.end());
+
+  for (size_t i = 0; i < m_events.size(); ++i) {
+    if (uint32_t* offset = payload_offset(m_events[i])) {
+      *offset = static_cast<uint32_t>(i * g_payload_slot_size);
     }
   }
-  return false;
+
+  m_events_head = 0;
+}
+
+bool
+Controller::button_was_pressed(int name) const
+{
+  return test_bit(m_buttons_pressed, name);
+}
+
+bool
+Controller::button_was_released(int name) const
+{
+  return test_bit(m_buttons_released, name);
 }
 
 bool
 Controller::axis_was_pressed_up(int name) const
 {
-  for(InputEventLst::const_iterator i = m_events.begin(); i != m_events.end(); ++i)
-  {
-    if (i->type == AXIS_EVENT && i->axis.name == name && i->axis.pos > 0.5f)
-    {
-      return true;
-    }
-  }
-  return false;
+  return test_bit(m_axes_up, name);
 }
 
 bool
 Controller::axis_was_pressed_down(int name) const
 {
-  for(InputEventLst::const_iterator i = m_events.begin(); i != m_events.end(); ++i)
-  {
-    if (i->type == AXIS_EVENT && i->axis.name == name && i->axis.pos < -0.5f)
-    {
-      return true;
-    }
+  return test_bit(m_axes_down, name);
+}
+
+uint64_t
+Controller::get_change_time(InputEventType type, int name) const
+{
+  std::vector<uint64_t> const& times = m_change_times[type];
+  if (static_cast<size_t>(name) >= times.size()) { return 0; }
+
+  return times[static_cast<size_t>(name)];
+}
+
+void
+Controller::set_change_time(InputEventType type, int name, uint64_t timestamp)
+{
+  std::vector<uint64_t>& times = m_change_times[type];
+  if (static_cast<size_t>(name) >= times.size()) { return; }
+
+  times[static_cast<size_t>(name)] = timestamp;
+}
+
+std::string_view
+Controller::get_text(InputEvent const& event) const
+{
+  if (event.type == TEXT_EVENT) {
+    return std::string_view(m_payload.data() + event.text.offset, event.text.size);
+  } else if (event.type == TEXT_EDIT_EVENT) {
+    return std::string_view(m_payload.data() + event.text_edit.offset, event.text_edit.size);
+  } else {
+    return {};
   }
-  return false;
+}
+
+SDL_KeyboardEvent
+Controller::get_keyboard_event(InputEvent const& event) const
+{
+  SDL_KeyboardEvent key{};
+  if (event.type == KEYBOARD_EVENT) {
+    memcpy(&key, m_payload.data() + event.keyboard.offset, sizeof(key));
+  }
+  return key;
 }
 
 void
 Controller::clear()
 {
   m_events.clear();
+  m_events_head = 0;
+  m_event_count = 0;
+  m_payload.clear();
+
+  std::fill(m_buttons_pressed.begin(), m_buttons_pressed.end(), 0);
+  std::fill(m_buttons_released.begin(), m_buttons_released.end(), 0);
+  std::fill(m_axes_up.begin(), m_axes_up.end(), 0);
+  std::fill(m_axes_down.begin(), m_axes_down.end(), 0);
+
+  for (std::vector<uint64_t>& times : m_change_times) {
+    std::fill(times.begin(), times.end(), 0);
+  }
+}
+
+void
+Controller::reset()
+{
+  clear();
+
+  std::fill(m_buttons.begin(), m_buttons.end(), 0);
+  std::fill(m_axes.begin(), m_axes.end(), 0.0f);
+  std::fill(m_balls.begin(), m_balls.end(), 0.0f);
+  std::fill(m_pointers.begin(), m_pointers.end(), 0.0f);
+  std::fill(m_sticks.begin(), m_sticks.end(), StickState());
 }
 
 void
-Controller::add_event(const InputEvent& event)
+Controller::assign(Controller const& other)
 {
-  m_events.push_back(event);
+  m_buttons = other.m_buttons;
+  m_axes = other.m_axes;
+  m_balls = other.m_balls;
+  m_pointers = other.m_pointers;
+  m_sticks = other.m_sticks;
+
+  m_buttons_pressed = other.m_buttons_pressed;
+  m_buttons_released = other.m_buttons_released;
+  m_axes_up = other.m_axes_up;
+  m_axes_down = other.m_axes_down;
+  m_change_times = other.m_change_times;
+
+  m_events = other.m_events;
+  m_events_head = other.m_events_head;
+  m_event_count = other.m_event_count;
+  m_payload = other.m_payload;
+  unwrap_events();
+
+  m_axis_deadzone = other.m_axis_deadzone;
+}
+
+void
+Controller::set_event_capacity(size_t capacity, EventOverflowPolicy policy)
+{
+  // the events and payload of this frame were laid out for the old
+  // policy
+  clear();
+
+  m_event_capacity = capacity;
+  m_overflow_policy = policy;
+
+  // room for every event to carry a payload
+  m_payload_capacity = capacity * g_payload_slot_size;
+
+  m_events.reserve(m_event_capacity);
+  m_payload.reserve(m_payload_capacity);
+}
+
+uint64_t
+Controller::add_event(InputEvent& event)
+{
+  uint64_t const timestamp = (m_timestamp != 0) ? m_timestamp : get_input_timestamp();
+  event.timestamp = to_event_timestamp(timestamp);
+  event.source = m_source;
+
+  if (m_event_capacity == 0 || m_events.size() < m_event_capacity)
+  {
+    m_events.push_back(event);
+    m_event_count += 1;
+    return timestamp;
+  }
+
+  m_overflow_count += 1;
+
+  switch (m_overflow_policy)
+  {
+    case OVERFLOW_DROP_OLDEST:
+      // overwrite the oldest event instead of shifting the whole buffer
+      m_events[m_events_head] = event;
+      m_event_count += 1;
+      m_events_head = (m_events_head + 1) % m_events.size();
+      break;
+
+    case OVERFLOW_COALESCE:
+      coalesce_event(event);
+      break;
+
+    case OVERFLOW_DROP_NEWEST:
+    default:
+      break;
+  }
+
+  return timestamp;
+}
+
+bool
+Controller::coalesce_event(const InputEvent& event)
+{
+  for (auto it = m_events.rbegin(); it != m_events.rend(); ++it)
+  {
+    if (it->type != event.type) {
+      continue;
+    }
+
+    switch (event.type)
+    {
+      case AXIS_EVENT:
+      case POINTER_EVENT:
+        if (it->axis.name == event.axis.name) {
+          it->axis.pos = event.axis.pos;
+          return true;
+        }
+        break;
+
+      case BALL_EVENT:
+        if (it->ball.name == event.ball.name) {
+          it->ball.pos += event.ball.pos;
+          return true;
+        }
+        break;
+
+      case STICK_EVENT:
+        if (it->stick.name == event.stick.name) {
+          it->stick.x = event.stick.x;
+          it->stick.y = event.stick.y;
+          return true;
+        }
+        break;
+
+      default:
+        return false;
+    }
+  }
+
+  return false;
+}
+
+bool
+Controller::add_payload(void const* data, size_t size, uint32_t& offset)
+{
+  if (m_event_capacity != 0 && m_overflow_policy == OVERFLOW_DROP_OLDEST)
+  {
+    if (size > g_payload_slot_size) {
+      m_overflow_count += 1;
+      return false;
+    }
+
+    // the slot of the event that add_event() is going to write
+    size_t const slot = (m_events.size() < m_event_capacity) ? m_events.size() : m_events_head;
+    size_t const start = slot * g_payload_slot_size;
+    if (m_payload.size() < start + g_payload_slot_size) {
+      m_payload.resize(start + g_payload_slot_size);
+    }
+
+    offset = static_cast<uint32_t>(start);
+    memcpy(m_payload.data() + start, data, size);
+    memset(m_payload.data() + start + size, 0, g_payload_slot_size - size);
+    return true;
+  }
+
+  if (m_payload_capacity != 0 && m_payload.size() + size > m_payload_capacity) {
+    m_overflow_count += 1;
+    return false;
+  }
+
+  offset = static_cast<uint32_t>(m_payload.size());
+  m_payload.insert(m_payload.end(),
+                   static_cast<char const*>(data),
+                   static_cast<char const*>(data) + size);
+  return true;
 }
 
 float
 Controller::get_ball_state(int id) const
 {
-  if (m_states.empty()) { return 0.0f; }
+  if (static_cast<size_t>(id) >= m_balls.size()) { return 0.0f; }
 
-  assert(id < int(m_states.size()));
-  return m_states[id].ball;
+  return m_balls[static_cast<size_t>(id)];
 }
 
 float
 Controller::get_pointer_state(int id) const
 {
-  if (m_states.empty()) { return 0.0f; }
+  if (static_cast<size_t>(id) >= m_pointers.size()) { return 0.0f; }
+
+  return m_pointers[static_cast<size_t>(id)];
+}
+
+StickState
+Controller::get_stick_state(int id) const
+{
+  if (static_cast<size_t>(id) >= m_sticks.size()) { return {}; }
+
+  return m_sticks[static_cast<size_t>(id)];
+}
+
+void
+Controller::set_stick_state(int id, float x, float y)
+{
+  if (static_cast<size_t>(id) >= m_sticks.size()) { return; }
 
-  assert(id < int(m_states.size()));
-  return m_states[id].pointer;
+  m_sticks[static_cast<size_t>(id)] = StickState{x, y};
 }
 
 void
 Controller::set_ball_state(int id, float pos)
 {
-  assert(id < static_cast<int>(m_states.size()));
-  m_states[id].ball = pos;
+  if (static_cast<size_t>(id) >= m_balls.size()) { return; }
+
+  m_balls[static_cast<size_t>(id)] = pos;
 }
 
 void
 Controller::set_pointer_state(int id, float pos)
 {
-  assert(id < static_cast<int>(m_states.size()));
-  m_states[id].pointer = pos;
+  if (static_cast<size_t>(id) >= m_pointers.size()) { return; }
+
+  m_pointers[static_cast<size_t>(id)] = pos;
 }
 
 void
 Controller::add_ball_event(int name, float pos)
 {
   InputEvent event;
+  // zero the padding too, so recordings of the same input are identical
+  memset(&event, 0, sizeof(event));
 
   event.type = BALL_EVENT;
   event.axis.name = name;
   event.axis.pos  = pos;
 
-  add_event(event);
+  uint64_t const timestamp = add_event(event);
   set_ball_state(name, pos);
+  set_change_time(BALL_EVENT, name, timestamp);
 }
 
 void
 Controller::add_pointer_event(int name, float pos)
 {
   InputEvent event;
+  memset(&event, 0, sizeof(event));
 
   event.type = POINTER_EVENT;
   event.axis.name = name;
   event.axis.pos  = pos;
 
-  add_event(event);
+  uint64_t const timestamp = add_event(event);
+  if (get_pointer_state(name) != pos) {
+    set_change_time(POINTER_EVENT, name, timestamp);
+  }
   set_pointer_state(name, pos);
 }
 
@@ -213,22 +558,57 @@ void
 Controller::add_button_event(int name, bool down)
 {
   InputEvent event;
+  memset(&event, 0, sizeof(event));
 
   event.type = BUTTON_EVENT;
   event.button.name = name;
   event.button.down = down;
 
-  add_event(event);
+  uint64_t const timestamp = add_event(event);
+  if (get_button_state(name) != down) {
+    set_change_time(BUTTON_EVENT, name, timestamp);
+  }
   set_button_state(name, down);
+  set_bit(down ? m_buttons_pressed : m_buttons_released, name, true);
+}
+
+void
+Controller::add_stick_event(int name, float x, float y)
+{
+  InputEvent event;
+  memset(&event, 0, sizeof(event));
+
+  event.type = STICK_EVENT;
+  event.stick.name = name;
+  event.stick.x = to_fixed(x);
+  event.stick.y = to_fixed(y);
+
+  // keep the state at the precision of the event, so that replaying
+  // the event reproduces it exactly
+  x = event.stick.get_x();
+  y = event.stick.get_y();
+
+  uint64_t const timestamp = add_event(event);
+  StickState const old = get_stick_state(name);
+  if (old.x != x || old.y != y) {
+    set_change_time(STICK_EVENT, name, timestamp);
+  }
+  set_stick_state(name, x, y);
 }
 
 void
 Controller::add_text_event(int , std::array<char, 32> const& text)
 {
   InputEvent event;
+  memset(&event, 0, sizeof(event));
+
+  size_t const size = strnlen(text.data(), text.size());
 
   event.type = TEXT_EVENT;
-  event.text.text = text;
+  if (!add_payload(text.data(), size, event.text.offset)) {
+    return;
+  }
+  event.text.size = static_cast<uint32_t>(size);
 
   add_event(event);
 }
@@ -237,11 +617,17 @@ void
 Controller::add_text_edit_event(int , std::array<char, 32> const& text, int start, int length)
 {
   InputEvent event;
+  memset(&event, 0, sizeof(event));
 
-  event.type = TEXT_EVENT;
-  event.text_edit.text = text;
-  event.text_edit.start = start;
-  event.text_edit.length = length;
+  size_t const size = strnlen(text.data(), text.size());
+
+  event.type = TEXT_EDIT_EVENT;
+  if (!add_payload(text.data(), size, event.text_edit.offset)) {
+    return;
+  }
+  event.text_edit.size = static_cast<uint16_t>(size);
+  event.text_edit.start = static_cast<uint8_t>(std::clamp(start, 0, 255));
+  event.text_edit.length = static_cast<uint8_t>(std::clamp(length, 0, 255));
 
   add_event(event);
 }
@@ -250,13 +636,91 @@ void
 Controller::add_keyboard_event(SDL_KeyboardEvent const& key)
 {
   InputEvent event;
+  memset(&event, 0, sizeof(event));
 
   event.type = KEYBOARD_EVENT;
-  event.keyboard.key = key;
+  if (!add_payload(&key, sizeof(key), event.keyboard.offset)) {
+    return;
+  }
 
   add_event(event);
 }
 
+void
+Controller::apply_event(InputEvent const& event, std::string_view payload)
+{
+  uint64_t const timestamp = m_timestamp;
+  InputEventSource const source = m_source;
+  m_timestamp = from_event_timestamp(event.timestamp, (timestamp != 0) ? timestamp : get_input_timestamp());
+  m_source = event.source;
+
+  switch (event.type)
+  {
+    case BUTTON_EVENT:
+      add_button_event(event.button.name, event.button.down);
+      break;
+
+    case AXIS_EVENT:
+      add_axis_event(event.axis.name, event.axis.pos);
+      break;
+
+    case BALL_EVENT:
+      add_ball_event(event.ball.name, event.ball.pos);
+      break;
+
+    case POINTER_EVENT:
+      add_pointer_event(event.axis.name, event.axis.pos);
+      break;
+
+    case STICK_EVENT:
+      add_stick_event(event.stick.name, event.stick.get_x(), event.stick.get_y());
+      break;
+
+    case TEXT_EVENT: {
+      InputEvent copy = event;
+      if (add_payload(payload.data(), payload.size(), copy.text.offset)) {
+        copy.text.size = static_cast<uint32_t>(payload.size());
+        add_event(copy);
+      }
+      break;
+    }
+
+    case TEXT_EDIT_EVENT: {
+      InputEvent copy = event;
+      if (add_payload(payload.data(), payload.size(), copy.text_edit.offset)) {
+        copy.text_edit.size = static_cast<uint16_t>(payload.size());
+        add_event(copy);
+      }
+      break;
+    }
+
+    case KEYBOARD_EVENT: {
+      InputEvent copy = event;
+      if (payload.size() == sizeof(SDL_KeyboardEvent) &&
+          add_payload(payload.data(), payload.size(), copy.keyboard.offset)) {
+        add_event(copy);
+      }
+      break;
+    }
+  }
+
+  m_timestamp = timestamp;
+  m_source = source;
+}
+
+void
+Controller::apply_events(std::span<InputEvent const> events, std::string_view payload)
+{
+  for (InputEvent const& event : events)
+  {
+    size_t offset;
+    size_t size;
+    if (get_payload_range(event, payload.size(), offset, size)) {
+      apply_event(event, payload.substr(offset, size));
+    }
+  }
+}
+
 void
 Controller::add_axis_event(int name, float pos)
 {
@@ -321,13 +785,23 @@ Controller::add_axis_event(int name, float pos)
 #endif
 
   InputEvent event;
+  memset(&event, 0, sizeof(event));
 
   event.type = AXIS_EVENT;
   event.axis.name = name;
   event.axis.pos  = pos;
 
-  add_event(event);
+  uint64_t const timestamp = add_event(event);
+  if (get_axis_state(name, false) != pos) {
+    set_change_time(AXIS_EVENT, name, timestamp);
+  }
   set_axis_state(name, pos);
+
+  if (pos > 0.5f) {
+    set_bit(m_axes_up, name, true);
+  } else if (pos < -0.5f) {
+    set_bit(m_axes_down, name, true);
+  }
 }
 
 } // namespace wstinput
@@ -69,6 +69,19 @@ ControllerDescription::add_ball(const std::string& name, int id)
   id_to_event[event.id]    = event;
 }
 
+void
+ControllerDescription::add_stick(const std::string& name, int id)
+{
+  InputEventDefinition event;
+
+  event.type = STICK_EVENT;
+  event.name = name;
+  event.id   = id;
+
+  str_to_event[event.name] = event;
+  id_to_event[event.id]    = event;
+}
+
 void
 ControllerDescription::add_axis(const std::string& name, int id)
 {
@@ -112,6 +125,18 @@ ControllerDescription::get_max_id() const
   return result;
 }
 
+int
+ControllerDescription::get_max_id(InputEventType type) const
+{
+  int result = -1;
+  for(auto const& item : id_to_event) {
+    if (item.second.type == type) {
+      result = std::max(result, item.first);
+    }
+  }
+  return result;
+}
+
 } // namespace wstinput
 
 /* EOF */
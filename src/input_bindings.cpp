@@ -17,6 +17,9 @@
 #include "input_bindings.hpp"
 
 #include <algorithm>
+#include <limits>
+#include <math.h>
+#include <numbers>
 
 #include <logmich/log.hpp>
 #include <prio/reader.hpp>
@@ -28,22 +31,40 @@ using namespace prio;
 
 namespace wstinput {
 
-// FIXME: this should be configurable and per axis
-constexpr int g_dead_zone = 0;
-
 InputBindings::InputBindings(InputManagerSDL& manager) :
   m_manager(manager),
   m_joystick_button_bindings(),
   m_joystick_button_axis_bindings(),
   m_joystick_axis_bindings(),
   m_joystick_axis_button_bindings(),
+  m_joystick_stick_bindings(),
   m_keyboard_button_bindings(),
   m_keyboard_axis_bindings(),
   m_mouse_button_bindings(),
   m_mouse_motion_bindings(),
   m_mouse_motion_ball_bindings(),
   m_wiimote_button_bindings(),
-  m_wiimote_axis_bindings()
+  m_wiimote_axis_bindings(),
+  m_socd_policy(SOCD_LAST_WINS),
+  m_key_state(),
+  m_mouse_motion_coalescing(false),
+  m_pending_pointer_motion(),
+  m_pending_ball_motion(),
+  m_dirty(false),
+  m_keyboard_offsets(),
+  m_keyboard_actions(),
+  m_joystick_axis_index(),
+  m_joystick_button_index(),
+  m_wiimote_button_index(),
+  m_wiimote_axis_index(),
+  m_wiimote_smoothing(0.2f),
+  m_wiimote_orientation(),
+  m_joystick_axis_filters(),
+  m_joystick_sticks(),
+  m_axis_curves(),
+  m_metrics(),
+  m_sdl_ticks_offset(0),
+  m_event_groups()
 {
 }
 
@@ -80,16 +101,18 @@ InputBindings::load(std::filesystem::path const& filename,
         bind_joystick_button(controller_description.get_definition(key).id,
                              device, button);
       } else if (button_obj.get_name() == "joystick-axis-button") {
-        int  device;
-        int  axis;
-        bool up;
+        int   device   = 0;
+        int   axis     = 0;
+        bool  up       = false;
+        float deadzone = 0.0f;
 
         button_map.read("device", device);
         button_map.read("axis", axis);
         button_map.read("up", up);
+        button_map.read("deadzone", deadzone);
 
         bind_joystick_axis_button(controller_description.get_definition(key).id,
-                                  device, axis, up);
+                                  device, axis, up, deadzone);
       } else if (button_obj.get_name() == "wiimote-button") {
         int device = 0;
         int button = 0;
@@ -117,16 +140,23 @@ InputBindings::load(std::filesystem::path const& filename,
 
       if (axis_obj.get_name() == "joystick-axis")
       {
-        int  device = 0;
-        int  axis   = 0;
-        bool invert = false;
+        int   device  = 0;
+        int   axis    = 0;
+        float epsilon = 0.0f;
+        AxisResponse response;
 
-        axis_map.read("device", device);
-        axis_map.read("axis",   axis);
-        axis_map.read("invert", invert);
+        axis_map.read("device",  device);
+        axis_map.read("axis",    axis);
+        axis_map.read("epsilon", epsilon);
+
+        axis_map.read("invert",         response.invert);
+        axis_map.read("deadzone",       response.deadzone);
+        axis_map.read("outer-deadzone", response.outer_deadzone);
+        axis_map.read("exponent",       response.exponent);
+        axis_map.read("scale",          response.scale);
 
         bind_joystick_axis(controller_description.get_definition(key).id,
-                           device, axis, invert);
+                           device, axis, response, epsilon);
       }
       else if (axis_obj.get_name() == "keyboard-axis")
       {
@@ -155,7 +185,44 @@ InputBindings::load(std::filesystem::path const& filename,
         log_error("InputManagerSDL: Unknown tag: {}", axis_obj.get_name());
       }
     }
+    else if (key.ends_with("-stick"))
+    {
+      ReaderObject stick_obj;
+      reader.read(key, stick_obj);
+      ReaderMapping const& stick_map = stick_obj.get_mapping();
+
+      if (stick_obj.get_name() == "joystick-stick")
+      {
+        int   device         = 0;
+        int   x_axis         = 0;
+        int   y_axis         = 1;
+        bool  invert_x       = false;
+        bool  invert_y       = false;
+        float deadzone       = 0.0f;
+        float outer_deadzone = 1.0f;
+        float exponent       = 1.0f;
+
+        stick_map.read("device",         device);
+        stick_map.read("x-axis",         x_axis);
+        stick_map.read("y-axis",         y_axis);
+        stick_map.read("invert-x",       invert_x);
+        stick_map.read("invert-y",       invert_y);
+        stick_map.read("deadzone",       deadzone);
+        stick_map.read("outer-deadzone", outer_deadzone);
+        stick_map.read("exponent",       exponent);
+
+        bind_joystick_stick(controller_description.get_definition(key).id,
+                            device, x_axis, y_axis, invert_x, invert_y,
+                            deadzone, outer_deadzone, exponent);
+      }
+      else
+      {
+        log_error("InputManagerSDL: Unknown tag: {}", stick_obj.get_name());
+      }
+    }
   }
+
+  compile();
 }
 
 void
@@ -168,6 +235,7 @@ InputBindings::bind_mouse_button(int event, int device, int button)
   binding.button = button;
 
   m_mouse_button_bindings.push_back(binding);
+  m_dirty = true;
 }
 
 void
@@ -180,6 +248,7 @@ InputBindings::bind_mouse_motion(int event, int device, int axis)
   binding.axis = axis;
 
   m_mouse_motion_bindings.push_back(binding);
+  m_dirty = true;
 }
 
 void
@@ -192,6 +261,7 @@ InputBindings::bind_mouse_motion_ball(int event, int device, int axis)
   binding.axis = axis;
 
   m_mouse_motion_ball_bindings.push_back(binding);
+  m_dirty = true;
 }
 
 void
@@ -213,21 +283,33 @@ InputBindings::bind_joystick_button_axis(int event, int device, int minus, int p
   binding.plus   = plus;
 
   m_joystick_button_axis_bindings.push_back(binding);
+  m_dirty = true;
 }
 
 void
-InputBindings::bind_joystick_axis(int event, int device, int axis, bool invert)
+InputBindings::bind_joystick_axis(int event, int device, int axis, bool invert, float epsilon)
+{
+  AxisResponse response;
+  response.invert = invert;
+
+  bind_joystick_axis(event, device, axis, response, epsilon);
+}
+
+void
+InputBindings::bind_joystick_axis(int event, int device, int axis, AxisResponse const& response, float epsilon)
 {
   m_manager.ensure_open_joystick(device);
 
   JoystickAxisBinding binding;
 
-  binding.event  = event;
-  binding.device = device;
-  binding.axis   = axis;
-  binding.invert = invert;
+  binding.event    = event;
+  binding.device   = device;
+  binding.axis     = axis;
+  binding.response = response;
+  binding.epsilon  = epsilon;
 
   m_joystick_axis_bindings.push_back(binding);
+  m_dirty = true;
 }
 
 void
@@ -242,21 +324,47 @@ InputBindings::bind_joystick_button(int event, int device, int button)
   binding.button = button;
 
   m_joystick_button_bindings.push_back(binding);
+  m_dirty = true;
 }
 
 void
-InputBindings::bind_joystick_axis_button(int event, int device, int axis, bool up)
+InputBindings::bind_joystick_axis_button(int event, int device, int axis, bool up, float deadzone)
 {
   m_manager.ensure_open_joystick(device);
 
   JoystickAxisButtonBinding binding;
 
-  binding.event  = event;
-  binding.device = device;
-  binding.axis   = axis;
-  binding.up   = up;
+  binding.event    = event;
+  binding.device   = device;
+  binding.axis     = axis;
+  binding.up       = up;
+  binding.deadzone = deadzone;
 
   m_joystick_axis_button_bindings.push_back(binding);
+  m_dirty = true;
+}
+
+void
+InputBindings::bind_joystick_stick(int event, int device, int x_axis, int y_axis,
+                                   bool invert_x, bool invert_y,
+                                   float deadzone, float outer_deadzone, float exponent)
+{
+  m_manager.ensure_open_joystick(device);
+
+  JoystickStickBinding binding;
+
+  binding.event          = event;
+  binding.device         = device;
+  binding.x_axis         = x_axis;
+  binding.y_axis         = y_axis;
+  binding.invert_x       = invert_x;
+  binding.invert_y       = invert_y;
+  binding.deadzone       = deadzone;
+  binding.outer_deadzone = outer_deadzone;
+  binding.exponent       = exponent;
+
+  m_joystick_stick_bindings.push_back(binding);
+  m_dirty = true;
 }
 
 void
@@ -268,6 +376,7 @@ InputBindings::bind_keyboard_button(int event, SDL_Scancode key)
   binding.key   = key;
 
   m_keyboard_button_bindings.push_back(binding);
+  m_dirty = true;
 }
 
 void
@@ -280,6 +389,7 @@ InputBindings::bind_keyboard_axis(int event, SDL_Scancode minus, SDL_Scancode pl
   binding.plus  = plus;
 
   m_keyboard_axis_bindings.push_back(binding);
+  m_dirty = true;
 }
 
 void
@@ -292,6 +402,7 @@ InputBindings::bind_wiimote_button(int event, int device, int button)
   binding.button = button;
 
   m_wiimote_button_bindings.push_back(binding);
+  m_dirty = true;
 }
 
 void
@@ -304,6 +415,7 @@ InputBindings::bind_wiimote_axis(int event, int device, int axis)
   binding.axis   = axis;
 
   m_wiimote_axis_bindings.push_back(binding);
+  m_dirty = true;
 }
 
 void
@@ -313,6 +425,7 @@ InputBindings::clear()
   m_joystick_axis_bindings.clear();
   m_joystick_button_axis_bindings.clear();
   m_joystick_axis_button_bindings.clear();
+  m_joystick_stick_bindings.clear();
 
   m_keyboard_button_bindings.clear();
   m_keyboard_axis_bindings.clear();
@@ -321,34 +434,165 @@ InputBindings::clear()
 
   m_wiimote_button_bindings.clear();
   m_wiimote_axis_bindings.clear();
+
+  m_dirty = true;
 }
 
 void
-InputBindings::dispatch_event(SDL_Event const& event, Controller& controller) const
+InputBindings::compile()
 {
-  switch(event.type)
-  {
-    case SDL_TEXTINPUT: {
-      std::array<char, 32> text;
-      std::copy_n(event.text.text, text.size(), text.begin());
-      controller.add_text_event(0, text);
-      break;
+  // Bucket the keyboard bindings by scancode, buttons first, then
+  // axis, so that the dispatch order matches the binding order
+  auto valid_key = [](SDL_Scancode key) {
+    return key >= 0 && key < SDL_NUM_SCANCODES;
+  };
+
+  std::array<uint32_t, SDL_NUM_SCANCODES> counts{};
+  for (KeyboardButtonBinding const& binding : m_keyboard_button_bindings) {
+    if (valid_key(binding.key)) {
+      counts[static_cast<size_t>(binding.key)] += 1;
+    } else {
+      log_error("InputBindings: invalid scancode: {}", static_cast<int>(binding.key));
+    }
+  }
+  for (KeyboardAxisBinding const& binding : m_keyboard_axis_bindings) {
+    if (valid_key(binding.minus) && valid_key(binding.plus)) {
+      counts[static_cast<size_t>(binding.minus)] += 1;
+      counts[static_cast<size_t>(binding.plus)] += 1;
+    } else {
+      log_error("InputBindings: invalid scancode: {} {}",
+                static_cast<int>(binding.minus), static_cast<int>(binding.plus));
     }
+  }
 
-    case SDL_TEXTEDITING: {
-      std::array<char, 32> text;
-      std::copy_n(event.text.text, text.size(), text.begin());
-      controller.add_text_edit_event(0, text, event.edit.start, event.edit.length);
-      break;
+  m_keyboard_offsets[0] = 0;
+  for (size_t i = 0; i < counts.size(); ++i) {
+    m_keyboard_offsets[i + 1] = m_keyboard_offsets[i] + counts[i];
+  }
+
+  m_keyboard_actions.resize(m_keyboard_offsets.back());
+
+  std::array<uint32_t, SDL_NUM_SCANCODES> fill{};
+  auto add_action = [&](SDL_Scancode key, KeyboardAction const& action) {
+    size_t const idx = static_cast<size_t>(key);
+    m_keyboard_actions[m_keyboard_offsets[idx] + fill[idx]] = action;
+    fill[idx] += 1;
+  };
+
+  for (KeyboardButtonBinding const& binding : m_keyboard_button_bindings) {
+    if (valid_key(binding.key)) {
+      add_action(binding.key, KeyboardAction{KeyboardAction::BUTTON, binding.event, SDL_SCANCODE_UNKNOWN});
+    }
+  }
+  for (KeyboardAxisBinding const& binding : m_keyboard_axis_bindings) {
+    if (valid_key(binding.minus) && valid_key(binding.plus)) {
+      add_action(binding.minus, KeyboardAction{KeyboardAction::AXIS_MINUS, binding.event, binding.plus});
+      add_action(binding.plus, KeyboardAction{KeyboardAction::AXIS_PLUS, binding.event, binding.minus});
     }
+  }
+
+  m_pending_pointer_motion.assign(m_mouse_motion_bindings.size(), PendingMotion{0.0f, false, 0});
+  m_pending_ball_motion.assign(m_mouse_motion_ball_bindings.size(), PendingMotion{0.0f, false, 0});
+
+  // NaN never compares equal, so the first sample always gets through
+  float const unset = std::numeric_limits<float>::quiet_NaN();
+
+  m_joystick_axis_index.clear();
+  m_joystick_axis_filters.clear();
+  m_axis_curves.clear();
+  for (JoystickAxisBinding const& binding : m_joystick_axis_bindings) {
+    m_joystick_axis_index.add(make_binding_key(binding.device, binding.axis),
+                              JoystickAxisAction{JoystickAxisAction::AXIS, binding.event, false,
+                                                 static_cast<uint32_t>(m_joystick_axis_filters.size()),
+                                                 get_axis_curve(binding.response)});
+    m_joystick_axis_filters.push_back(JoystickAxisFilter{binding.epsilon, unset});
+  }
+  for (JoystickAxisButtonBinding const& binding : m_joystick_axis_button_bindings) {
+    AxisResponse response;
+    response.deadzone = binding.deadzone;
+
+    m_joystick_axis_index.add(make_binding_key(binding.device, binding.axis),
+                              JoystickAxisAction{JoystickAxisAction::AXIS_BUTTON, binding.event, binding.up,
+                                                 static_cast<uint32_t>(m_joystick_axis_filters.size()),
+                                                 get_axis_curve(response)});
+    m_joystick_axis_filters.push_back(JoystickAxisFilter{0.0f, unset});
+  }
+  m_joystick_sticks.clear();
+  for (JoystickStickBinding const& binding : m_joystick_stick_bindings) {
+    uint32_t const stick = static_cast<uint32_t>(m_joystick_sticks.size());
+
+    // the radial deadzone is applied in flush(), the curves only normalize
+    AxisResponse x_response;
+    x_response.invert = binding.invert_x;
+    AxisResponse y_response;
+    y_response.invert = binding.invert_y;
+
+    m_joystick_axis_index.add(make_binding_key(binding.device, binding.x_axis),
+                              JoystickAxisAction{JoystickAxisAction::STICK_X, binding.event, false,
+                                                 stick, get_axis_curve(x_response)});
+    m_joystick_axis_index.add(make_binding_key(binding.device, binding.y_axis),
+                              JoystickAxisAction{JoystickAxisAction::STICK_Y, binding.event, false,
+                                                 stick, get_axis_curve(y_response)});
+    m_joystick_sticks.push_back(JoystickStickState{0.0f, 0.0f, unset, unset, false, 0});
+  }
+  m_joystick_axis_index.build();
+
+  m_joystick_button_index.clear();
+  for (JoystickButtonBinding const& binding : m_joystick_button_bindings) {
+    m_joystick_button_index.add(make_binding_key(binding.device, binding.button),
+                                JoystickButtonAction{JoystickButtonAction::BUTTON, binding.event});
+  }
+  for (JoystickButtonAxisBinding const& binding : m_joystick_button_axis_bindings) {
+    m_joystick_button_index.add(make_binding_key(binding.device, binding.minus),
+                                JoystickButtonAction{JoystickButtonAction::AXIS_MINUS, binding.event});
+    if (binding.plus != binding.minus) {
+      m_joystick_button_index.add(make_binding_key(binding.device, binding.plus),
+                                  JoystickButtonAction{JoystickButtonAction::AXIS_PLUS, binding.event});
+    }
+  }
+  m_joystick_button_index.build();
+
+  m_wiimote_button_index.clear();
+  for (WiimoteButtonBinding const& binding : m_wiimote_button_bindings) {
+    m_wiimote_button_index.add(make_binding_key(binding.device, binding.button), binding.event);
+  }
+  m_wiimote_button_index.build();
+
+  m_wiimote_axis_index.clear();
+  for (WiimoteAxisBinding const& binding : m_wiimote_axis_bindings) {
+    m_wiimote_axis_index.add(make_binding_key(binding.device, binding.axis), binding.event);
+  }
+  m_wiimote_axis_index.build();
+
+  m_dirty = false;
+}
+
+void
+InputBindings::dispatch_event(SDL_Event const& event, Controller& controller)
+{
+  if (m_dirty) {
+    compile();
+  }
+
+  EventGroup const group = get_event_group(event.type);
+  m_metrics.sdl_events[group] += 1;
+
+  uint64_t const now = get_input_timestamp();
+  update_sdl_ticks_offset(now);
+
+  controller.set_timestamp(from_sdl_timestamp(event.common.timestamp, now));
+  controller.set_source(get_event_source(group));
+
+  switch(event.type)
+  {
+    case SDL_TEXTINPUT:
+    case SDL_TEXTEDITING:
+      dispatch_keyboard_event(event, false, controller);
+      break;
 
     case SDL_KEYUP:
     case SDL_KEYDOWN:
-      if (m_manager.is_text_input_active()) {
-        controller.add_keyboard_event(event.key);
-      } else {
-        dispatch_key_event(event.key, controller);
-      }
+      dispatch_keyboard_event(event, m_manager.is_text_input_active(), controller);
       break;
 
     case SDL_MOUSEMOTION:
@@ -370,10 +614,12 @@ InputBindings::dispatch_event(SDL_Event const& event, Controller& controller) co
 
     case SDL_JOYBALLMOTION:
       // event.jball
+      m_metrics.ignored_events += 1;
       break;
 
     case SDL_JOYHATMOTION:
       // event.jhat
+      m_metrics.ignored_events += 1;
       break;
 
     case SDL_JOYBUTTONUP:
@@ -403,57 +649,339 @@ InputBindings::dispatch_event(SDL_Event const& event, Controller& controller) co
     case SDL_RENDER_TARGETS_RESET:
     case SDL_RENDER_DEVICE_RESET:
     case SDL_USEREVENT:
+      m_metrics.ignored_events += 1;
       break;
 
     default:
       log_debug("InputManagerSDL: unknown event: ", event.type);
+      m_metrics.ignored_events += 1;
       break;
   }
+
+  controller.set_timestamp(0);
+  controller.set_source(OTHER_SOURCE);
+}
+
+uint32_t
+InputBindings::get_axis_curve(AxisResponse const& response)
+{
+  for (size_t i = 0; i < m_axis_curves.size(); ++i) {
+    if (m_axis_curves[i].get_response() == response) {
+      return static_cast<uint32_t>(i);
+    }
+  }
+
+  m_axis_curves.emplace_back(response);
+  return static_cast<uint32_t>(m_axis_curves.size() - 1);
 }
 
 void
-InputBindings::dispatch_key_event(const SDL_KeyboardEvent& event, Controller& controller) const
+InputBindings::update_sdl_ticks_offset(uint64_t now)
 {
-  // Dynamic bindings
-  for (std::vector<KeyboardButtonBinding>::const_iterator i = m_keyboard_button_bindings.begin();
-       i != m_keyboard_button_bindings.end();
-       ++i)
+  // SDL_GetTicks() is truncated to whole milliseconds, so \a now lies
+  // anywhere within that millisecond, take the middle of it
+  m_sdl_ticks_offset = now - uint64_t{SDL_GetTicks()} * 1000000 - 500000;
+}
+
+uint64_t
+InputBindings::from_sdl_timestamp(Uint32 timestamp, uint64_t now) const
+{
+  // SDL only has millisecond resolution, events without a timestamp
+  // are taken to have happened right now
+  if (timestamp == 0) {
+    return now;
+  }
+
+  return std::min(m_sdl_ticks_offset + uint64_t{timestamp} * 1000000, now);
+}
+
+InputEventSource
+InputBindings::get_event_source(EventGroup group)
+{
+  switch (group)
   {
-    if (event.keysym.scancode == i->key)
-    {
-      controller.add_button_event(i->event, event.state);
+    case KEYBOARD_GROUP:
+      return KEYBOARD_SOURCE;
+
+    case MOUSE_MOTION_GROUP:
+    case MOUSE_BUTTON_GROUP:
+      return MOUSE_SOURCE;
+
+    case JOY_AXIS_GROUP:
+    case JOY_BUTTON_GROUP:
+      return JOYSTICK_SOURCE;
+
+    default:
+      return OTHER_SOURCE;
+  }
+}
+
+EventGroup
+InputBindings::get_event_group(Uint32 type)
+{
+  switch(type)
+  {
+    case SDL_KEYUP:
+    case SDL_KEYDOWN:
+    case SDL_TEXTINPUT:
+    case SDL_TEXTEDITING:
+      return KEYBOARD_GROUP;
+
+    case SDL_MOUSEMOTION:
+      return MOUSE_MOTION_GROUP;
+
+    case SDL_MOUSEBUTTONDOWN:
+    case SDL_MOUSEBUTTONUP:
+    case SDL_MOUSEWHEEL:
+      return MOUSE_BUTTON_GROUP;
+
+    case SDL_JOYAXISMOTION:
+      return JOY_AXIS_GROUP;
+
+    case SDL_JOYBUTTONUP:
+    case SDL_JOYBUTTONDOWN:
+      return JOY_BUTTON_GROUP;
+
+    default:
+      return OTHER_GROUP;
+  }
+}
+
+void
+InputBindings::dispatch_events(std::span<SDL_Event const> events, Controller& controller)
+{
+  if (m_dirty) {
+    compile();
+  }
+
+  uint64_t const now = get_input_timestamp();
+  update_sdl_ticks_offset(now);
+
+  // counting sort of the events into their groups
+  std::array<size_t, NUM_EVENT_GROUPS + 1> offsets{};
+  for (SDL_Event const& event : events) {
+    offsets[static_cast<size_t>(get_event_group(event.type)) + 1] += 1;
+  }
+  // OTHER_GROUP is counted by dispatch_event()
+  for (size_t i = 0; i < OTHER_GROUP; ++i) {
+    m_metrics.sdl_events[i] += offsets[i + 1];
+  }
+  for (size_t i = 1; i < offsets.size(); ++i) {
+    offsets[i] += offsets[i - 1];
+  }
+
+  m_event_groups.resize(events.size());
+  std::array<size_t, NUM_EVENT_GROUPS> fill{};
+  for (SDL_Event const& event : events) {
+    size_t const group = static_cast<size_t>(get_event_group(event.type));
+    m_event_groups[offsets[group] + fill[group]] = &event;
+    fill[group] += 1;
+  }
+
+  auto stamp = [&](SDL_Event const& event, InputEventSource source) {
+    controller.set_timestamp(from_sdl_timestamp(event.common.timestamp, now));
+    controller.set_source(source);
+  };
+
+  auto group_events = [&](EventGroup group) {
+    size_t const idx = static_cast<size_t>(group);
+    return std::span<SDL_Event const* const>(m_event_groups.data() + offsets[idx],
+                                             offsets[idx + 1] - offsets[idx]);
+  };
+
+  if (offsets[KEYBOARD_GROUP] != offsets[KEYBOARD_GROUP + 1]) {
+    bool const text_input_active = m_manager.is_text_input_active();
+    for (SDL_Event const* event : group_events(KEYBOARD_GROUP)) {
+      stamp(*event, KEYBOARD_SOURCE);
+      dispatch_keyboard_event(*event, text_input_active, controller);
     }
   }
 
-  const Uint8* keystate = SDL_GetKeyboardState(nullptr);
+  for (SDL_Event const* event : group_events(MOUSE_MOTION_GROUP)) {
+    stamp(*event, MOUSE_SOURCE);
+    dispatch_mouse_motion_event(event->motion, controller);
+  }
 
-  for (std::vector<KeyboardAxisBinding>::const_iterator i = m_keyboard_axis_bindings.begin();
-       i != m_keyboard_axis_bindings.end();
-       ++i)
+  for (SDL_Event const* event : group_events(MOUSE_BUTTON_GROUP)) {
+    stamp(*event, MOUSE_SOURCE);
+    if (event->type == SDL_MOUSEWHEEL) {
+      dispatch_mouse_wheel_event(event->wheel, controller);
+    } else {
+      dispatch_mouse_button_event(event->button, controller);
+    }
+  }
+
+  for (SDL_Event const* event : group_events(JOY_AXIS_GROUP)) {
+    stamp(*event, JOYSTICK_SOURCE);
+    dispatch_joy_axis_event(event->jaxis, controller);
+  }
+
+  for (SDL_Event const* event : group_events(JOY_BUTTON_GROUP)) {
+    stamp(*event, JOYSTICK_SOURCE);
+    dispatch_joy_button_event(event->jbutton, controller);
+  }
+
+  for (SDL_Event const* event : group_events(OTHER_GROUP)) {
+    dispatch_event(*event, controller);
+  }
+
+  controller.set_timestamp(0);
+  controller.set_source(OTHER_SOURCE);
+}
+
+void
+InputBindings::set_wiimote_smoothing(float smoothing)
+{
+  m_wiimote_smoothing = smoothing;
+  for (OrientationFilter& filter : m_wiimote_orientation) {
+    filter.set_smoothing(smoothing);
+  }
+}
+
+void
+InputBindings::dispatch_wiimote_axis(int device, int axis, float pos, Controller& controller)
+{
+  std::span<int const> const events = m_wiimote_axis_index.find(make_binding_key(device, axis));
+  m_metrics.bindings_matched += events.size();
+  for (int id : events) {
+    controller.add_axis_event(id, pos);
+  }
+}
+
+void
+InputBindings::dispatch_wiimote_event(WiimoteEvent const& event, Controller& controller)
+{
+  if (m_dirty) {
+    compile();
+  }
+
+  controller.set_source(WIIMOTE_SOURCE);
+
+  switch (event.type)
   {
-    if (event.keysym.scancode == i->minus)
-    {
-      if (event.state)
-        controller.add_axis_event(i->event, -1.0f);
-      else if (!keystate[i->plus])
-        controller.add_axis_event(i->event, 0.0f);
+    case WiimoteEvent::WIIMOTE_BUTTON_EVENT: {
+      std::span<int const> const events = m_wiimote_button_index.find(make_binding_key(event.button.device, event.button.button));
+      m_metrics.bindings_matched += events.size();
+      for (int id : events) {
+        controller.add_button_event(id, event.button.down);
+      }
+      break;
     }
-    else if (event.keysym.scancode == i->plus)
-    {
-      if (event.state)
+
+    case WiimoteEvent::WIIMOTE_AXIS_EVENT:
+      dispatch_wiimote_axis(event.axis.device, event.axis.axis, event.axis.pos, controller);
+      break;
+
+    case WiimoteEvent::WIIMOTE_ACC_EVENT:
+      // only the Wiimote itself, not the Nunchuk, is used for
+      // orientation, the samples are turned into axis events by flush()
+      if (event.acc.accelerometer == 0 && event.acc.device >= 0)
       {
-        controller.add_axis_event(i->event, 1.0f);
+        size_t const device = static_cast<size_t>(event.acc.device);
+        if (device >= m_wiimote_orientation.size()) {
+          m_wiimote_orientation.resize(device + 1, OrientationFilter(m_wiimote_smoothing));
+        }
+
+        uint64_t const timestamp = controller.get_timestamp();
+        m_wiimote_orientation[device].add_sample(event.acc.x, event.acc.y, event.acc.z,
+                                                 timestamp ? timestamp : get_input_timestamp());
       }
-      else if (!keystate[i->minus])
-      {
-        controller.add_axis_event(i->event, 0.0f);
+      break;
+  }
+
+  controller.set_source(OTHER_SOURCE);
+}
+
+void
+InputBindings::dispatch_keyboard_event(SDL_Event const& event, bool text_input_active, Controller& controller)
+{
+  switch(event.type)
+  {
+    case SDL_TEXTINPUT: {
+      std::array<char, 32> text;
+      std::copy_n(event.text.text, text.size(), text.begin());
+      controller.add_text_event(0, text);
+      break;
+    }
+
+    case SDL_TEXTEDITING: {
+      std::array<char, 32> text;
+      std::copy_n(event.text.text, text.size(), text.begin());
+      controller.add_text_edit_event(0, text, event.edit.start, event.edit.length);
+      break;
+    }
+
+    case SDL_KEYUP:
+    case SDL_KEYDOWN:
+      if (event.key.keysym.scancode >= 0 && event.key.keysym.scancode < SDL_NUM_SCANCODES) {
+        m_key_state.set(event.key.keysym.scancode, event.key.state == SDL_PRESSED);
+      }
+
+      if (text_input_active) {
+        controller.add_keyboard_event(event.key);
+      } else {
+        dispatch_key_event(event.key, controller);
+      }
+      break;
+  }
+}
+
+void
+InputBindings::dispatch_key_event(const SDL_KeyboardEvent& event, Controller& controller)
+{
+  SDL_Scancode const scancode = event.keysym.scancode;
+  if (scancode < 0 || scancode >= SDL_NUM_SCANCODES) {
+    return;
+  }
+
+  size_t const idx = static_cast<size_t>(scancode);
+  m_metrics.bindings_matched += m_keyboard_offsets[idx + 1] - m_keyboard_offsets[idx];
+  for (uint32_t i = m_keyboard_offsets[idx]; i != m_keyboard_offsets[idx + 1]; ++i)
+  {
+    KeyboardAction const& action = m_keyboard_actions[i];
+    switch (action.type)
+    {
+      case KeyboardAction::BUTTON:
+        controller.add_button_event(action.event, event.state);
+        break;
+
+      case KeyboardAction::AXIS_MINUS:
+      case KeyboardAction::AXIS_PLUS: {
+        float const dir = (action.type == KeyboardAction::AXIS_MINUS) ? -1.0f : 1.0f;
+        bool const other_down = m_key_state.test(action.other);
+
+        float pos;
+        if (!event.state) {
+          pos = other_down ? -dir : 0.0f;
+        } else if (!other_down) {
+          pos = dir;
+        } else {
+          switch (m_socd_policy)
+          {
+            case SOCD_NEUTRAL:
+              pos = 0.0f;
+              break;
+
+            case SOCD_FIRST_WINS:
+              pos = -dir;
+              break;
+
+            case SOCD_LAST_WINS:
+            default:
+              pos = dir;
+              break;
+          }
+        }
+
+        controller.add_axis_event(action.event, pos);
+        break;
       }
     }
   }
 }
 
 void
-InputBindings::dispatch_mouse_button_event(const SDL_MouseButtonEvent& button, Controller& controller) const
+InputBindings::dispatch_mouse_button_event(const SDL_MouseButtonEvent& button, Controller& controller)
 {
   for (std::vector<MouseButtonBinding>::const_iterator i = m_mouse_button_bindings.begin();
        i != m_mouse_button_bindings.end();
@@ -461,120 +989,240 @@ InputBindings::dispatch_mouse_button_event(const SDL_MouseButtonEvent& button, C
   {
     if (button.button == i->button)
     {
+      m_metrics.bindings_matched += 1;
       controller.add_button_event(i->event, button.state);
     }
   }
 }
 
 void
-InputBindings::dispatch_mouse_motion_event(SDL_MouseMotionEvent const& motion, Controller& controller) const
+InputBindings::dispatch_mouse_motion_event(SDL_MouseMotionEvent const& motion, Controller& controller)
 {
-  for (MouseMotionBinding const& binding : m_mouse_motion_bindings)
+  for (size_t i = 0; i < m_mouse_motion_bindings.size(); ++i)
   {
+    MouseMotionBinding const& binding = m_mouse_motion_bindings[i];
     if (static_cast<int>(motion.which) == binding.device)
     {
+      m_metrics.bindings_matched += 1;
+
+      float pos;
       if (binding.axis == 0) {
-        controller.add_pointer_event(binding.event, static_cast<float>(motion.x));
+        pos = static_cast<float>(motion.x);
       } else if (binding.axis == 1) {
-        controller.add_pointer_event(binding.event, static_cast<float>(motion.y));
+        pos = static_cast<float>(motion.y);
       } else {
         log_error("unknown axis in binding: {}", binding.axis);
+        continue;
+      }
+
+      if (m_mouse_motion_coalescing) {
+        m_pending_pointer_motion[i] = PendingMotion{pos, true, controller.get_timestamp()};
+      } else {
+        controller.add_pointer_event(binding.event, pos);
       }
     }
   }
 
-  for (MouseMotionBallBinding const& binding : m_mouse_motion_ball_bindings)
+  for (size_t i = 0; i < m_mouse_motion_ball_bindings.size(); ++i)
   {
+    MouseMotionBallBinding const& binding = m_mouse_motion_ball_bindings[i];
+
+    float delta;
     if (binding.axis == 0) {
-      controller.add_ball_event(binding.event, static_cast<float>(motion.xrel));
+      delta = static_cast<float>(motion.xrel);
     } else if (binding.axis == 1) {
-      controller.add_ball_event(binding.event, static_cast<float>(motion.yrel));
+      delta = static_cast<float>(motion.yrel);
     } else {
       log_error("unknown axis in binding: {}", binding.axis);
+      continue;
+    }
+
+    m_metrics.bindings_matched += 1;
+    if (m_mouse_motion_coalescing) {
+      m_pending_ball_motion[i].value += delta;
+      m_pending_ball_motion[i].pending = true;
+      m_pending_ball_motion[i].timestamp = controller.get_timestamp();
+    } else {
+      controller.add_ball_event(binding.event, delta);
     }
   }
 }
 
 void
-InputBindings::dispatch_mouse_wheel_event(SDL_MouseWheelEvent const& wheel, Controller& controller) const
+InputBindings::flush(Controller& controller)
 {
+  for (size_t i = 0; i < m_pending_pointer_motion.size(); ++i)
+  {
+    PendingMotion& motion = m_pending_pointer_motion[i];
+    if (motion.pending) {
+      controller.set_timestamp(motion.timestamp);
+      controller.set_source(MOUSE_SOURCE);
+      controller.add_pointer_event(m_mouse_motion_bindings[i].event, motion.value);
+      motion = PendingMotion{0.0f, false, 0};
+    }
+  }
 
-}
-
-void
-InputBindings::dispatch_joy_button_event(const SDL_JoyButtonEvent& button, Controller& controller) const
-{
-  for (std::vector<JoystickButtonBinding>::const_iterator i = m_joystick_button_bindings.begin();
-       i != m_joystick_button_bindings.end();
-       ++i)
+  for (size_t i = 0; i < m_pending_ball_motion.size(); ++i)
   {
-    if (button.which  == i->device &&
-        button.button == i->button)
-    {
-      controller.add_button_event(i->event, button.state);
+    PendingMotion& motion = m_pending_ball_motion[i];
+    if (motion.pending) {
+      controller.set_timestamp(motion.timestamp);
+      controller.set_source(MOUSE_SOURCE);
+      controller.add_ball_event(m_mouse_motion_ball_bindings[i].event, motion.value);
+      motion = PendingMotion{0.0f, false, 0};
     }
   }
 
-  for (std::vector<JoystickButtonAxisBinding>::const_iterator i = m_joystick_button_axis_bindings.begin();
-       i != m_joystick_button_axis_bindings.end();
-       ++i)
+  for (size_t i = 0; i < m_joystick_sticks.size(); ++i)
   {
-    if (button.which  == i->device)
+    JoystickStickState& stick = m_joystick_sticks[i];
+    if (!stick.pending) {
+      continue;
+    }
+    stick.pending = false;
+
+    JoystickStickBinding const& binding = m_joystick_stick_bindings[i];
+
+    float x = 0.0f;
+    float y = 0.0f;
+    float const length = sqrtf(stick.x * stick.x + stick.y * stick.y);
+    if (length > binding.deadzone)
     {
-      if (button.button == i->minus)
-      {
-        controller.add_axis_event(i->event, button.state ? -1.0f : 0.0f);
-      }
-      else if (button.button == i->plus)
-      {
-        controller.add_axis_event(i->event, button.state ?  1.0f : 0.0f);
+      float const range = binding.outer_deadzone - binding.deadzone;
+      float t = (range > 0.0f) ? std::min((length - binding.deadzone) / range, 1.0f) : 1.0f;
+      if (binding.exponent != 1.0f) {
+        t = powf(t, binding.exponent);
       }
+      x = stick.x * t / length;
+      y = stick.y * t / length;
+    }
+
+    if (x != stick.last_x || y != stick.last_y)
+    {
+      stick.last_x = x;
+      stick.last_y = y;
+      controller.set_timestamp(stick.timestamp);
+      controller.set_source(JOYSTICK_SOURCE);
+      controller.add_stick_event(binding.event, x, y);
+    }
+    else
+    {
+      m_metrics.suppressed_axis_events += 1;
     }
   }
+
+  for (size_t device = 0; device < m_wiimote_orientation.size(); ++device)
+  {
+    OrientationFilter& filter = m_wiimote_orientation[device];
+    if (!filter.is_pending()) {
+      continue;
+    }
+
+    float pitch;
+    float roll;
+    filter.update(pitch, roll);
+
+    float const pi = std::numbers::pi_v<float>;
+    controller.set_timestamp(filter.get_timestamp());
+    controller.set_source(WIIMOTE_SOURCE);
+    dispatch_wiimote_axis(static_cast<int>(device), WIIMOTE_PITCH_AXIS, std::clamp(-pitch / pi, -1.0f, 1.0f), controller);
+    dispatch_wiimote_axis(static_cast<int>(device), WIIMOTE_ROLL_AXIS, std::clamp(-roll / pi, -1.0f, 1.0f), controller);
+  }
+
+  controller.set_timestamp(0);
+  controller.set_source(OTHER_SOURCE);
 }
 
 void
-InputBindings::dispatch_joy_axis_event(const SDL_JoyAxisEvent& event, Controller& controller) const
+InputBindings::dispatch_mouse_wheel_event(SDL_MouseWheelEvent const& /*wheel*/, Controller& /*controller*/)
 {
-  for (std::vector<JoystickAxisBinding>::const_iterator i = m_joystick_axis_bindings.begin();
-       i != m_joystick_axis_bindings.end();
-       ++i)
+  m_metrics.ignored_events += 1;
+}
+
+void
+InputBindings::dispatch_joy_button_event(const SDL_JoyButtonEvent& button, Controller& controller)
+{
+  std::span<JoystickButtonAction const> const actions = m_joystick_button_index.find(make_binding_key(button.which, button.button));
+  m_metrics.bindings_matched += actions.size();
+  for (JoystickButtonAction const& action : actions)
   {
-    if (event.which  == i->device &&
-        event.axis   == i->axis)
+    switch (action.type)
     {
-      if (abs(event.value) > g_dead_zone)
-      {
-        controller.add_axis_event(i->event, static_cast<float>(event.value) / (i->invert ? -32768.0f : 32768.0f));
-      }
-      else
-      {
-        controller.add_axis_event(i->event, 0);
-      }
+      case JoystickButtonAction::BUTTON:
+        controller.add_button_event(action.event, button.state);
+        break;
+
+      case JoystickButtonAction::AXIS_MINUS:
+        controller.add_axis_event(action.event, button.state ? -1.0f : 0.0f);
+        break;
+
+      case JoystickButtonAction::AXIS_PLUS:
+        controller.add_axis_event(action.event, button.state ?  1.0f : 0.0f);
+        break;
     }
   }
+}
 
-  for(std::vector<JoystickAxisButtonBinding>::const_iterator i = m_joystick_axis_button_bindings.begin();
-      i != m_joystick_axis_button_bindings.end();
-      ++i)
+void
+InputBindings::dispatch_joy_axis_event(const SDL_JoyAxisEvent& event, Controller& controller)
+{
+  std::span<JoystickAxisAction const> const actions = m_joystick_axis_index.find(make_binding_key(event.which, event.axis));
+  m_metrics.bindings_matched += actions.size();
+  for (JoystickAxisAction const& action : actions)
   {
-    if (event.which == i->device &&
-        event.axis  == i->axis)
+    float const pos = m_axis_curves[action.curve](event.value);
+
+    switch (action.type)
     {
-      if (i->up)
-      { // signal button press when axis is up
-        if (event.value < -g_dead_zone)
-          controller.add_button_event(i->event, true);
+      case JoystickAxisAction::AXIS: {
+        JoystickAxisFilter& filter = m_joystick_axis_filters[action.filter];
+
+        // rest and end positions always get through, so that the
+        // epsilon can't keep the axis from settling
+        if (pos == filter.last ||
+            (fabsf(pos - filter.last) < filter.epsilon && pos != 0.0f && fabsf(pos) < 1.0f))
+        {
+          m_metrics.suppressed_axis_events += 1;
+        }
         else
-          controller.add_button_event(i->event, false);
+        {
+          filter.last = pos;
+          controller.add_axis_event(action.event, pos);
+        }
+        break;
       }
-      else
-      { // signal button press when axis is down
-        if (event.value > g_dead_zone)
-          controller.add_button_event(i->event, true);
+
+      case JoystickAxisAction::AXIS_BUTTON: {
+        JoystickAxisFilter& filter = m_joystick_axis_filters[action.filter];
+
+        bool const down = action.flag
+          ? (pos < 0.0f)  // signal button press when axis is up
+          : (pos > 0.0f); // signal button press when axis is down
+
+        float const state = down ? 1.0f : 0.0f;
+        if (state == filter.last)
+        {
+          m_metrics.suppressed_axis_button_events += 1;
+        }
         else
-          controller.add_button_event(i->event, false);
+        {
+          filter.last = state;
+          controller.add_button_event(action.event, down);
+        }
+        break;
       }
+
+      case JoystickAxisAction::STICK_X:
+        m_joystick_sticks[action.filter].x = pos;
+        m_joystick_sticks[action.filter].pending = true;
+        m_joystick_sticks[action.filter].timestamp = controller.get_timestamp();
+        break;
+
+      case JoystickAxisAction::STICK_Y:
+        m_joystick_sticks[action.filter].y = pos;
+        m_joystick_sticks[action.filter].pending = true;
+        m_joystick_sticks[action.filter].timestamp = controller.get_timestamp();
+        break;
     }
   }
 }
@@ -14,26 +14,57 @@
 // You should have received a copy of the GNU Lesser General Public License
 // along with this program. If not, see <http://www.gnu.org/licenses/>.
 
+#include <algorithm>
+#include <array>
 #include <sstream>
+#include <stdexcept>
+#include <string.h>
 
 #include <logmich/log.hpp>
 #include <prio/reader.hpp>
 
 #include "input_manager.hpp"
+#include "input_recorder.hpp"
 #ifdef HAVE_CWIID
-#  include "wiimote.hpp"
+#  include "wiimote_manager.hpp"
 #endif
 
 using namespace prio;
 
 namespace wstinput {
 
+namespace {
+
+/** Number of events pump() takes out of the SDL queue at once */
+constexpr int g_pump_chunk_size = 64;
+
+} // namespace
+
 InputManagerSDL::InputManagerSDL(ControllerDescription const& controller_description) :
   m_controller_description(controller_description),
-  m_controller(controller_description.get_max_id() + 1),
+  m_controller(controller_description),
   m_bindings(*this),
+  m_snapshots(controller_description),
   m_joysticks(),
-  m_keyidmapping()
+  m_keyidmapping(),
+  m_input_thread(),
+  m_input_thread_running(false),
+  m_input_queue(),
+  m_thread_controller(),
+  m_thread_unsent(0),
+  m_latency_stats(),
+  m_consumed_events(0),
+  m_latency_report_interval(),
+  m_latency_report_time(),
+  m_dispatch_metrics(),
+  m_thread_dispatch_metrics(),
+  m_thread_metrics(),
+  m_frames(0),
+  m_update_time(0),
+  m_recorder()
+#ifdef HAVE_CWIID
+  , m_wiimotes(std::make_unique<WiimoteManager>())
+#endif
 {
   log_debug("Keyboard keys:");
   for (int i = 0; i < SDL_NUM_SCANCODES; ++i) {
@@ -43,23 +74,17 @@ InputManagerSDL::InputManagerSDL(ControllerDescription const& controller_descrip
     log_debug("  {}", key_name);
   }
 
-  stop_text_input();
-
-#ifdef HAVE_CWIID
-  // FIXME: doesn't really belong here
-  Wiimote::init();
+#ifdef WSTINPUT_LATENCY_STATS
+  m_latency_stats = std::make_unique<LatencyStats>();
+#endif
 
-  if (wiimote && config.get<bool>("wiimote").get())
-    wiimote->connect();
+  stop_text_input();
 
-#endif // HAVE_CWIID
 }
 
 InputManagerSDL::~InputManagerSDL()
 {
-#ifdef HAVE_CWIID
-  Wiimote::deinit();
-#endif
+  stop_input_thread();
 }
 
 void
@@ -112,84 +137,401 @@ InputManagerSDL::ensure_open_joystick(int device)
 void
 InputManagerSDL::on_event(const SDL_Event& event)
 {
+  uint64_t const start = get_input_timestamp();
+  uint64_t const first = m_controller.get_event_count();
   m_bindings.dispatch_event(event, m_controller);
+  record_dispatch(m_controller, first, start, m_dispatch_metrics);
 }
 
 void
-InputManagerSDL::update(float /*delta*/)
+InputManagerSDL::dispatch_events(std::span<SDL_Event const> events)
 {
-#ifdef HAVE_CWIID
-  if (wiimote && wiimote->is_connected())
+  uint64_t const start = get_input_timestamp();
+  uint64_t const first = m_controller.get_event_count();
+  m_bindings.dispatch_events(events, m_controller);
+  record_dispatch(m_controller, first, start, m_dispatch_metrics);
+}
+
+void
+InputManagerSDL::pump()
+{
+  SDL_PumpEvents();
+
+  uint64_t const start = get_input_timestamp();
+  uint64_t const first = m_controller.get_event_count();
+  drain_events(m_controller);
+  m_bindings.flush(m_controller);
+  record_dispatch(m_controller, first, start, m_dispatch_metrics);
+}
+
+void
+InputManagerSDL::record_dispatch(Controller const& controller, uint64_t first, uint64_t start,
+                                 DispatchMetrics& metrics)
+{
+  uint64_t const now = get_input_timestamp();
+  uint64_t const added = controller.get_event_count() - first;
+
+  metrics.input_events += added;
+  metrics.dispatch_time += now - start;
+
+#ifdef WSTINPUT_LATENCY_STATS
+  // once the event buffer is full, only the newest of the added events
+  // are still around
+  size_t const size = controller.get_events().size();
+  for (size_t i = size - std::min<uint64_t>(added, size); i < size; ++i) {
+    m_latency_stats->record(DISPATCH_LATENCY, controller.get_event(i), now);
+  }
+#endif
+}
+
+InputEventLst const&
+InputManagerSDL::get_events()
+{
+  m_controller.unwrap_events();
+  InputEventLst const& events = m_controller.get_events();
+
+#ifdef WSTINPUT_LATENCY_STATS
+  uint64_t const now = get_input_timestamp();
+  uint64_t const added = m_controller.get_event_count() - m_consumed_events;
+  for (size_t i = events.size() - std::min<uint64_t>(added, events.size()); i < events.size(); ++i) {
+    m_latency_stats->record(CONSUME_LATENCY, events[i], now);
+  }
+#endif
+  m_consumed_events = m_controller.get_event_count();
+
+  return events;
+}
+
+void
+InputManagerSDL::set_latency_report_interval(std::chrono::milliseconds interval)
+{
+  m_latency_report_interval = interval;
+  m_latency_report_time = std::chrono::steady_clock::now() + m_latency_report_interval;
+}
+
+void
+InputManagerSDL::report_latency()
+{
+  if (!m_latency_stats ||
+      m_latency_report_interval == std::chrono::steady_clock::duration::zero()) {
+    return;
+  }
+
+  auto const now = std::chrono::steady_clock::now();
+  if (now < m_latency_report_time) {
+    return;
+  }
+  m_latency_report_time = now + m_latency_report_interval;
+
+  std::string const report = m_latency_stats->to_string();
+  if (!report.empty()) {
+    log_info("InputManagerSDL: input latency\n{}", report);
+  }
+}
+
+void
+InputManagerSDL::drain_events(Controller& controller)
+{
+  struct EventRange { Uint32 first; Uint32 last; };
+  static constexpr std::array<EventRange, 3> ranges = {{
+      { SDL_KEYDOWN, SDL_TEXTINPUT },
+      { SDL_MOUSEMOTION, SDL_MOUSEWHEEL },
+      { SDL_JOYAXISMOTION, SDL_JOYBUTTONUP }
+    }};
+
+  std::array<SDL_Event, g_pump_chunk_size> buffer;
+  for (EventRange const& range : ranges)
   {
-    // Check for new events from the Wiimote
-    std::vector<WiimoteEvent> events = wiimote->pop_events();
-    for(std::vector<WiimoteEvent>::iterator i = events.begin(); i != events.end(); ++i)
+    int count;
+    while ((count = SDL_PeepEvents(buffer.data(), g_pump_chunk_size, SDL_GETEVENT, range.first, range.last)) > 0)
     {
-      WiimoteEvent& event = *i;
-      if (event.type == WiimoteEvent::WIIMOTE_BUTTON_EVENT)
-      {
-        for (std::vector<WiimoteButtonBinding>::const_iterator j = m_wiimote_button_bindings.begin();
-             j != m_wiimote_button_bindings.end();
-             ++j)
-        {
-          if (event.button.device == j->device &&
-              event.button.button == j->button)
-          {
-            add_button_event(j->event, event.button.down);
-          }
-        }
-      }
-      else if (event.type == WiimoteEvent::WIIMOTE_AXIS_EVENT)
-      {
-        for (std::vector<WiimoteAxisBinding>::const_iterator j = m_wiimote_axis_bindings.begin();
-             j != m_wiimote_axis_bindings.end();
-             ++j)
-        {
-          if (event.axis.device == j->device &&
-              event.axis.axis == j->axis)
-          {
-            add_axis_event(j->event, event.axis.pos);
-          }
-        }
-      }
-      else if (event.type == WiimoteEvent::WIIMOTE_ACC_EVENT)
+      m_bindings.dispatch_events(std::span<SDL_Event const>(buffer.data(), static_cast<size_t>(count)), controller);
+    }
+  }
+}
+
+void
+InputManagerSDL::start_input_thread(int rate, size_t queue_capacity)
+{
+  if (m_input_thread.joinable()) {
+    return;
+  }
+
+  m_input_queue = std::make_unique<SPSCQueue<QueuedInputEvent>>(queue_capacity);
+  m_thread_dispatch_metrics = DispatchMetrics();
+  m_thread_controller = std::make_unique<Controller>(m_controller_description);
+  m_thread_unsent = 0;
+  m_input_thread_running.store(true, std::memory_order_release);
+  m_input_thread = std::thread([this, rate]{
+    input_thread_main(std::chrono::nanoseconds(1000000000 / std::max(rate, 1)));
+  });
+}
+
+void
+InputManagerSDL::stop_input_thread()
+{
+  if (!m_input_thread.joinable()) {
+    return;
+  }
+
+  m_input_thread_running.store(false, std::memory_order_release);
+  m_input_thread.join();
+
+  // don't lose what the thread left in the queue or couldn't get into
+  // it, it may hold button releases
+  QueuedInputEvent queued;
+  while (m_input_queue->pop(queued))
+  {
+    m_controller.apply_event(queued.event, std::string_view(queued.payload.data(), queued.payload_size));
+  }
+
+  InputEventLst const& unsent = m_thread_controller->get_events();
+  for (size_t i = m_thread_unsent; i < unsent.size(); ++i)
+  {
+    queued = make_queued_event(*m_thread_controller, unsent[i]);
+    m_controller.apply_event(queued.event, std::string_view(queued.payload.data(), queued.payload_size));
+  }
+  m_thread_controller->clear();
+  m_thread_unsent = 0;
+
+  m_dispatch_metrics += m_thread_dispatch_metrics;
+  m_thread_dispatch_metrics = DispatchMetrics();
+}
+
+InputManagerSDL::QueuedInputEvent
+InputManagerSDL::make_queued_event(Controller const& controller, InputEvent const& event)
+{
+  QueuedInputEvent queued;
+  queued.event = event;
+  queued.payload_size = 0;
+
+  if (event.type == KEYBOARD_EVENT) {
+    SDL_KeyboardEvent const key = controller.get_keyboard_event(event);
+    memcpy(queued.payload.data(), &key, sizeof(key));
+    queued.payload_size = sizeof(key);
+  } else if (event.type == TEXT_EVENT || event.type == TEXT_EDIT_EVENT) {
+    std::string_view const text = controller.get_text(event);
+    queued.payload_size = static_cast<uint32_t>(text.copy(queued.payload.data(), queued.payload.size()));
+  }
+
+  return queued;
+}
+
+void
+InputManagerSDL::input_thread_main(std::chrono::nanoseconds period)
+{
+  Controller& controller = *m_thread_controller;
+  auto next = std::chrono::steady_clock::now();
+
+  while (m_input_thread_running.load(std::memory_order_acquire))
+  {
+    // joystick events are generated outside of SDL_PumpEvents(), so
+    // they can be sampled faster than the frame rate
+    SDL_JoystickUpdate();
+
+    uint64_t const start = get_input_timestamp();
+    drain_events(controller);
+    poll_wiimote(controller, m_thread_dispatch_metrics);
+    m_bindings.flush(controller);
+    record_dispatch(controller, 0, start, m_thread_dispatch_metrics);
+
+    controller.unwrap_events();
+    InputEventLst const& events = controller.get_events();
+    for (size_t i = 0; i < events.size(); ++i)
+    {
+      QueuedInputEvent const queued = make_queued_event(controller, events[i]);
+
+      // never drop an event, a lost button release would leave the
+      // button stuck on the main thread, wait for update() instead
+      while (!m_input_queue->push(queued))
       {
-        if (event.acc.accelerometer == 0)
-        {
-          if (0)
-            printf("%d - %6.3f %6.3f %6.3f\n",
-                   event.acc.accelerometer,
-                   event.acc.x,
-                   event.acc.y,
-                   event.acc.z);
-
-          float roll = atanf(static_cast<float>(event.acc.x / event.acc.z));
-          if (event.acc.z <= 0.0) {
-            roll += math::pi * ((event.acc.x > 0.0f) ? 1.0f : -1.0f);
-          }
-          roll *= -1;
-
-          float pitch = atanf(event.acc.y / event.acc.z * cosf(roll));
-
-          add_axis_event(X2_AXIS, math::mid(-1.0f, -float(pitch / M_PI), 1.0f));
-          add_axis_event(Y2_AXIS, math::mid(-1.0f, -float(roll  / M_PI), 1.0f));
-
-          log_debug("{:6.3f} {:6.3f}", pitch, roll);
+        if (!m_input_thread_running.load(std::memory_order_acquire)) {
+          // stop_input_thread() applies the rest
+          m_thread_unsent = i;
+          return;
         }
+        std::this_thread::sleep_for(period);
       }
-      else
-      {
-        assert(!"Never reached");
-      }
     }
+    controller.clear();
+
+    InputMetrics& metrics = m_thread_metrics.back();
+    metrics.bindings = m_bindings.get_metrics();
+    metrics.dispatch = m_thread_dispatch_metrics;
+    m_thread_metrics.publish();
+
+    // don't rush through missed periods after a stall, e.g. a long
+    // wait for room in the queue
+    next += period;
+    auto const now = std::chrono::steady_clock::now();
+    if (next < now) {
+      next = now;
+    }
+    std::this_thread::sleep_until(next);
+  }
+}
+
+void
+InputManagerSDL::update(float /*delta*/)
+{
+  uint64_t const start = get_input_timestamp();
+
+  if (m_input_thread.joinable())
+  {
+    // SDL only allows pumping from the main thread, the input thread
+    // picks the events up from the queue
+    SDL_PumpEvents();
+
+    QueuedInputEvent queued;
+    while (m_input_queue->pop(queued))
+    {
+      m_controller.apply_event(queued.event, std::string_view(queued.payload.data(), queued.payload_size));
+    }
+  }
+  else
+  {
+    uint64_t const first = m_controller.get_event_count();
+    // the Wiimote orientation is reported by flush()
+    poll_wiimote(m_controller, m_dispatch_metrics);
+    m_bindings.flush(m_controller);
+    record_dispatch(m_controller, first, start, m_dispatch_metrics);
+  }
+
+  m_controller.unwrap_events();
+
+  report_latency();
+
+  m_frames += 1;
+  m_update_time += get_input_timestamp() - start;
+}
+
+InputMetrics
+InputManagerSDL::get_metrics()
+{
+  InputMetrics metrics;
+
+  metrics.dispatch = m_dispatch_metrics;
+  if (m_input_thread.joinable()) {
+    m_thread_metrics.acquire();
+    metrics.bindings = m_thread_metrics.front().bindings;
+    metrics.dispatch += m_thread_metrics.front().dispatch;
+  } else {
+    metrics.bindings = m_bindings.get_metrics();
+  }
+
+  metrics.frames = m_frames;
+  metrics.update_time = m_update_time;
+  metrics.overflow_events = m_controller.get_overflow_count();
+  if (m_input_queue) {
+    metrics.overflow_events += m_input_queue->get_overflow_count();
+  }
+
+  return metrics;
+}
+
+void
+InputManagerSDL::poll_wiimote([[maybe_unused]] Controller& controller,
+                              [[maybe_unused]] DispatchMetrics& metrics)
+{
+#ifdef HAVE_CWIID
+  uint64_t const count = m_wiimotes->drain([&](WiimoteEvent const& event) {
+    switch (event.type)
+    {
+      case WiimoteEvent::WIIMOTE_BUTTON_EVENT:
+        metrics.wiimote_button_events += 1;
+        break;
+
+      case WiimoteEvent::WIIMOTE_AXIS_EVENT:
+        metrics.wiimote_axis_events += 1;
+        break;
+
+      case WiimoteEvent::WIIMOTE_ACC_EVENT:
+        metrics.wiimote_acc_events += 1;
+        break;
+    }
+
+    m_bindings.dispatch_wiimote_event(event, controller);
+  });
+
+  if (count != 0) {
+    metrics.wiimote_pops += 1;
+    metrics.wiimote_max_pop_size = std::max(metrics.wiimote_max_pop_size, count);
   }
 #endif
 }
 
+void
+InputManagerSDL::publish_snapshot()
+{
+  m_snapshots.back().assign(m_controller);
+  m_snapshots.publish();
+}
+
+Controller const&
+InputManagerSDL::acquire_snapshot()
+{
+  m_snapshots.acquire();
+  return m_snapshots.front();
+}
+
 void
 InputManagerSDL::clear()
 {
+  if (m_recorder) {
+    m_controller.unwrap_events();
+    try {
+      m_recorder->record_frame(m_controller);
+    } catch (std::exception const& err) {
+      log_error("InputManagerSDL: recording stopped: {}", err.what());
+      m_recorder.reset();
+    }
+  }
+
   m_controller.clear();
+  m_consumed_events = 0;
+}
+
+int
+InputManagerSDL::connect_wiimote()
+{
+#ifdef HAVE_CWIID
+  return m_wiimotes->connect();
+#else
+  log_error("InputManagerSDL: built without Wiimote support");
+  return -1;
+#endif
+}
+
+void
+InputManagerSDL::disconnect_wiimotes()
+{
+#ifdef HAVE_CWIID
+  if (is_input_thread_running()) {
+    log_error("InputManagerSDL: can't disconnect Wiimotes while the input thread is running");
+    return;
+  }
+
+  m_wiimotes->disconnect();
+#endif
+}
+
+void
+InputManagerSDL::start_recording(std::filesystem::path const& filename)
+{
+  m_recorder = std::make_unique<InputRecorder>(filename);
+}
+
+void
+InputManagerSDL::stop_recording()
+{
+  if (m_recorder) {
+    try {
+      m_recorder->flush();
+    } catch (std::exception const& err) {
+      log_error("InputManagerSDL: recording incomplete: {}", err.what());
+    }
+    m_recorder.reset();
+  }
 }
 
 void
@@ -0,0 +1,96 @@
+// Windstille Input Library
+// Copyright (C) 2005-2020 Ingo Ruhnke <grumbel@gmail.com>
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+// License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#include "input_recorder.hpp"
+
+#include <stdexcept>
+#include <string.h>
+#include <string>
+
+#include "controller.hpp"
+
+namespace wstinput {
+
+namespace {
+
+constexpr size_t g_buffer_size = 1024 * 1024;
+
+} // namespace
+
+InputRecorder::InputRecorder(std::filesystem::path const& filename) :
+  m_buffer(g_buffer_size),
+  m_out(),
+  m_frame_count(0)
+{
+  // the buffer has to be set before the file is opened to take effect
+  m_out.rdbuf()->pubsetbuf(m_buffer.data(), static_cast<std::streamsize>(m_buffer.size()));
+  m_out.open(filename, std::ios::binary | std::ios::trunc);
+  if (!m_out) {
+    throw std::runtime_error("InputRecorder: couldn't open " + filename.string());
+  }
+
+  RecordingHeader header{};
+  memcpy(header.magic, g_recording_magic, sizeof(header.magic));
+  header.version = g_recording_version;
+  header.event_size = sizeof(InputEvent);
+  m_out.write(reinterpret_cast<char const*>(&header), sizeof(header));
+  if (!m_out) {
+    throw std::runtime_error("InputRecorder: couldn't write " + filename.string());
+  }
+}
+
+void
+InputRecorder::record_frame(Controller const& controller)
+{
+  InputEventLst const& events = controller.get_events();
+  std::string_view const payload = controller.get_payload();
+
+  RecordingFrameHeader header{};
+  header.timestamp = (controller.get_timestamp() != 0) ? controller.get_timestamp() : get_input_timestamp();
+  header.event_count = static_cast<uint32_t>(events.size());
+  header.payload_size = static_cast<uint32_t>(payload.size());
+
+  m_out.write(reinterpret_cast<char const*>(&header), sizeof(header));
+  m_out.write(reinterpret_cast<char const*>(events.data()),
+              static_cast<std::streamsize>(events.size() * sizeof(InputEvent)));
+  m_out.write(payload.data(), static_cast<std::streamsize>(payload.size()));
+
+  static constexpr char padding[g_recording_alignment] = {};
+  size_t const remainder = (events.size() * sizeof(InputEvent) + payload.size()) % g_recording_alignment;
+  if (remainder != 0) {
+    m_out.write(padding, static_cast<std::streamsize>(g_recording_alignment - remainder));
+  }
+
+  // the stream is buffered, so a full disk shows up a few frames late
+  if (!m_out) {
+    throw std::runtime_error("InputRecorder: write failed after " + std::to_string(m_frame_count) + " frames");
+  }
+
+  m_frame_count += 1;
+}
+
+void
+InputRecorder::flush()
+{
+  m_out.flush();
+  if (!m_out) {
+    throw std::runtime_error("InputRecorder: flush failed after " + std::to_string(m_frame_count) + " frames");
+  }
+}
+
+} // namespace wstinput
+
+/* EOF */
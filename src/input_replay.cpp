@@ -0,0 +1,137 @@
+// Windstille Input Library
+// Copyright (C) 2005-2020 Ingo Ruhnke <grumbel@gmail.com>
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+// License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#include "input_replay.hpp"
+
+#include <fcntl.h>
+#include <stdexcept>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "controller.hpp"
+#include "input_recorder.hpp"
+
+namespace wstinput {
+
+InputReplay::InputReplay(std::filesystem::path const& filename) :
+  m_data(nullptr),
+  m_size(0),
+  m_pos(sizeof(RecordingHeader))
+{
+  int const fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error("InputReplay: couldn't open " + filename.string());
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(RecordingHeader)) {
+    close(fd);
+    throw std::runtime_error("InputReplay: " + filename.string() + " is not a recording");
+  }
+  m_size = static_cast<size_t>(st.st_size);
+
+  void* const data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    throw std::runtime_error("InputReplay: couldn't map " + filename.string());
+  }
+  m_data = data;
+
+  // frames are read front to back
+  madvise(data, m_size, MADV_SEQUENTIAL);
+
+  RecordingHeader header;
+  memcpy(&header, m_data, sizeof(header));
+  if (memcmp(header.magic, g_recording_magic, sizeof(header.magic)) != 0 ||
+      header.version != g_recording_version ||
+      header.event_size != sizeof(InputEvent))
+  {
+    munmap(data, m_size);
+    throw std::runtime_error("InputReplay: " + filename.string() + " is not a compatible recording");
+  }
+}
+
+InputReplay::~InputReplay()
+{
+  munmap(const_cast<void*>(m_data), m_size);
+}
+
+bool
+InputReplay::read_frame(RecordedFrame& frame)
+{
+  char const* const base = static_cast<char const*>(m_data);
+
+  if (m_size - m_pos < sizeof(RecordingFrameHeader)) {
+    return false;
+  }
+
+  RecordingFrameHeader const* const header = reinterpret_cast<RecordingFrameHeader const*>(base + m_pos);
+  size_t const events_size = size_t{header->event_count} * sizeof(InputEvent);
+  size_t const data_size = events_size + size_t{header->payload_size};
+  size_t const frame_size = sizeof(RecordingFrameHeader) +
+    (data_size + g_recording_alignment - 1) / g_recording_alignment * g_recording_alignment;
+  if (m_size - m_pos < frame_size) {
+    return false;
+  }
+
+  char const* const events = base + m_pos + sizeof(RecordingFrameHeader);
+  frame.timestamp = header->timestamp;
+  frame.events = std::span<InputEvent const>(reinterpret_cast<InputEvent const*>(events), header->event_count);
+  frame.payload = std::string_view(events + events_size, header->payload_size);
+
+  // a corrupt payload reference ends the replay, like a truncated frame
+  for (InputEvent const& event : frame.events)
+  {
+    size_t offset;
+    size_t size;
+    if (!get_payload_range(event, frame.payload.size(), offset, size)) {
+      m_pos = m_size;
+      return false;
+    }
+  }
+
+  m_pos += frame_size;
+  return true;
+}
+
+bool
+InputReplay::replay_frame(Controller& controller)
+{
+  RecordedFrame frame;
+  if (!read_frame(frame)) {
+    return false;
+  }
+
+  // the event timestamps are relative to the recording's clock
+  uint64_t const timestamp = controller.get_timestamp();
+  controller.clear();
+  controller.set_timestamp(frame.timestamp);
+  controller.apply_events(frame.events, frame.payload);
+  controller.set_timestamp(timestamp);
+  return true;
+}
+
+void
+InputReplay::rewind()
+{
+  m_pos = sizeof(RecordingHeader);
+}
+
+} // namespace wstinput
+
+/* EOF */
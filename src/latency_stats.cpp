@@ -0,0 +1,178 @@
+// Windstille Input Library
+// Copyright (C) 2005-2020 Ingo Ruhnke <grumbel@gmail.com>
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+// License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#include "latency_stats.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <iomanip>
+#include <sstream>
+
+namespace wstinput {
+
+namespace {
+
+char const* source_name(size_t source)
+{
+  switch (source)
+  {
+    case KEYBOARD_SOURCE: return "keyboard";
+    case MOUSE_SOURCE: return "mouse";
+    case JOYSTICK_SOURCE: return "joystick";
+    case WIIMOTE_SOURCE: return "wiimote";
+    default: return "other";
+  }
+}
+
+char const* stage_name(size_t stage)
+{
+  switch (stage)
+  {
+    case DISPATCH_LATENCY: return "dispatch";
+    case CONSUME_LATENCY: return "consume";
+    default: return "unknown";
+  }
+}
+
+} // namespace
+
+LatencyHistogram::LatencyHistogram() :
+  m_buckets(),
+  m_max(0)
+{
+  reset();
+}
+
+size_t
+LatencyHistogram::bucket_index(uint64_t value)
+{
+  constexpr uint64_t sub_count = uint64_t{1} << g_sub_bits;
+
+  if (value < sub_count) {
+    return static_cast<size_t>(value);
+  }
+
+  // the highest bit selects the power of two, the g_sub_bits below it
+  // the sub-bucket
+  int const msb = static_cast<int>(std::bit_width(value)) - 1;
+  uint64_t const sub = (value >> (msb - g_sub_bits)) - sub_count;
+  size_t const index = static_cast<size_t>(msb - g_sub_bits + 1) * sub_count + sub;
+  return std::min(index, g_num_buckets - 1);
+}
+
+uint64_t
+LatencyHistogram::bucket_upper_bound(size_t index)
+{
+  constexpr size_t sub_count = size_t{1} << g_sub_bits;
+
+  if (index < sub_count) {
+    return index;
+  }
+
+  int const shift = static_cast<int>(index / sub_count) - 1;
+  uint64_t const lower = (sub_count + index % sub_count) << shift;
+  return lower + (uint64_t{1} << shift) - 1;
+}
+
+uint64_t
+LatencyHistogram::get_count() const
+{
+  uint64_t count = 0;
+  for (std::atomic<uint64_t> const& bucket : m_buckets) {
+    count += bucket.load(std::memory_order_relaxed);
+  }
+  return count;
+}
+
+uint64_t
+LatencyHistogram::get_percentile(double fraction) const
+{
+  uint64_t const count = get_count();
+  if (count == 0) {
+    return 0;
+  }
+
+  uint64_t const rank = std::max(uint64_t{1}, static_cast<uint64_t>(fraction * static_cast<double>(count) + 0.5));
+  uint64_t seen = 0;
+  for (size_t i = 0; i < m_buckets.size(); ++i) {
+    seen += m_buckets[i].load(std::memory_order_relaxed);
+    if (seen >= rank) {
+      return std::min(bucket_upper_bound(i), get_max());
+    }
+  }
+  return get_max();
+}
+
+LatencySummary
+LatencyHistogram::get_summary() const
+{
+  LatencySummary summary;
+  summary.count = get_count();
+  summary.p50 = get_percentile(0.50);
+  summary.p99 = get_percentile(0.99);
+  summary.max = get_max();
+  return summary;
+}
+
+void
+LatencyHistogram::reset()
+{
+  for (std::atomic<uint64_t>& bucket : m_buckets) {
+    bucket.store(0, std::memory_order_relaxed);
+  }
+  m_max.store(0, std::memory_order_relaxed);
+}
+
+LatencyStats::LatencyStats() :
+  m_histograms()
+{
+}
+
+std::string
+LatencyStats::to_string() const
+{
+  std::ostringstream out;
+  out << std::fixed << std::setprecision(3);
+  for (size_t stage = 0; stage < m_histograms.size(); ++stage) {
+    for (size_t source = 0; source < m_histograms[stage].size(); ++source) {
+      LatencySummary const summary = m_histograms[stage][source].get_summary();
+      if (summary.count == 0) {
+        continue;
+      }
+
+      out << source_name(source) << ' ' << stage_name(stage)
+          << ": n=" << summary.count
+          << " p50=" << static_cast<double>(summary.p50) / 1e6 << "ms"
+          << " p99=" << static_cast<double>(summary.p99) / 1e6 << "ms"
+          << " max=" << static_cast<double>(summary.max) / 1e6 << "ms\n";
+    }
+  }
+  return out.str();
+}
+
+void
+LatencyStats::reset()
+{
+  for (auto& histograms : m_histograms) {
+    for (LatencyHistogram& histogram : histograms) {
+      histogram.reset();
+    }
+  }
+}
+
+} // namespace wstinput
+
+/* EOF */
@@ -0,0 +1,109 @@
+// Windstille Input Library
+// Copyright (C) 2005-2020 Ingo Ruhnke <grumbel@gmail.com>
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+// License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "orientation_filter.hpp"
+
+#include <algorithm>
+#include <math.h>
+#include <numbers>
+
+namespace wstinput {
+
+float
+fast_atan2(float y, float x)
+{
+  float const ax = fabsf(x);
+  float const ay = fabsf(y);
+  float const hi = std::max(ax, ay);
+  if (hi == 0.0f) {
+    return 0.0f;
+  }
+
+  // minimax polynomial for atan() on [0, 1]
+  float const t = std::min(ax, ay) / hi;
+  float const t2 = t * t;
+  float r = -0.01172120f;
+  r = r * t2 + 0.05265332f;
+  r = r * t2 - 0.11643287f;
+  r = r * t2 + 0.19354346f;
+  r = r * t2 - 0.33262347f;
+  r = r * t2 + 0.99997726f;
+  r = r * t;
+
+  // unfold the octant
+  r = (ay > ax) ? std::numbers::pi_v<float> / 2.0f - r : r;
+  r = (x < 0.0f) ? std::numbers::pi_v<float> - r : r;
+  return copysignf(r, y);
+}
+
+OrientationFilter::OrientationFilter(float smoothing) :
+  m_smoothing(smoothing),
+  m_x(0.0f),
+  m_y(0.0f),
+  m_z(0.0f),
+  m_valid(false),
+  m_pending(false),
+  m_timestamp(0)
+{
+}
+
+void
+OrientationFilter::add_sample(float x, float y, float z, uint64_t timestamp)
+{
+  if (m_valid)
+  {
+    m_x += (x - m_x) * m_smoothing;
+    m_y += (y - m_y) * m_smoothing;
+    m_z += (z - m_z) * m_smoothing;
+  }
+  else
+  {
+    m_x = x;
+    m_y = y;
+    m_z = z;
+    m_valid = true;
+  }
+
+  m_pending = true;
+  m_timestamp = timestamp;
+}
+
+void
+OrientationFilter::update(float& pitch, float& roll)
+{
+  // roll is the rotation around the pointing direction, pitch the
+  // angle between the pointing direction and the horizontal plane
+  roll = -fast_atan2(m_x, m_z);
+  pitch = fast_atan2(m_y, sqrtf(m_x * m_x + m_z * m_z));
+
+  m_pending = false;
+}
+
+void
+OrientationFilter::reset()
+{
+  m_x = 0.0f;
+  m_y = 0.0f;
+  m_z = 0.0f;
+  m_valid = false;
+  m_pending = false;
+  m_timestamp = 0;
+}
+
+} // namespace wstinput
+
+/* EOF */
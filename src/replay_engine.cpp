@@ -0,0 +1,112 @@
+// Windstille Input Library
+// Copyright (C) 2005-2020 Ingo Ruhnke <grumbel@gmail.com>
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+// License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+#include "replay_engine.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <logmich/log.hpp>
+
+#include "controller.hpp"
+#include "input_replay.hpp"
+
+namespace wstinput {
+
+ReplayEngine::ReplayEngine(ControllerDescription const& description, size_t threads) :
+  m_description(description),
+  m_thread_count(threads != 0 ? threads : std::max(1u, std::thread::hardware_concurrency())),
+  m_frame_callback()
+{
+}
+
+ReplayStats
+ReplayEngine::run(std::span<std::filesystem::path const> sessions)
+{
+  // sessions differ a lot in length, so instead of splitting them up
+  // front every worker takes the next one once it is done
+  std::atomic<size_t> next_session(0);
+
+  std::vector<ReplayStats> worker_stats(m_thread_count);
+  auto worker = [&](ReplayStats& result) {
+    Controller controller(m_description);
+
+    // counted locally, so that the workers don't share cache lines
+    ReplayStats stats;
+
+    size_t session;
+    while ((session = next_session.fetch_add(1, std::memory_order_relaxed)) < sessions.size())
+    {
+      controller.reset();
+
+      try
+      {
+        InputReplay replay(sessions[session]);
+        while (replay.replay_frame(controller))
+        {
+          stats.frames += 1;
+          stats.events += controller.get_events().size();
+          if (m_frame_callback) {
+            m_frame_callback(session, controller);
+          }
+        }
+        stats.sessions += 1;
+      }
+      catch (std::exception const& err)
+      {
+        log_error("ReplayEngine: {}", err.what());
+        stats.failed += 1;
+      }
+    }
+
+    result = stats;
+  };
+
+  auto const start = std::chrono::steady_clock::now();
+
+  // std::jthread joins on destruction, so the workers already started
+  // are waited for when starting another one throws
+  std::vector<std::jthread> threads;
+  threads.reserve(m_thread_count - 1);
+  for (size_t i = 1; i < m_thread_count; ++i) {
+    threads.emplace_back(worker, std::ref(worker_stats[i]));
+  }
+  worker(worker_stats[0]);
+  for (std::jthread& thread : threads) {
+    thread.join();
+  }
+
+  ReplayStats result;
+  for (ReplayStats const& stats : worker_stats) {
+    result.sessions += stats.sessions;
+    result.failed += stats.failed;
+    result.frames += stats.frames;
+    result.events += stats.events;
+  }
+  result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  log_info("ReplayEngine: {} sessions in {:.3f}s, {:.1f} sessions/s on {} threads",
+           result.sessions, result.seconds, result.get_sessions_per_second(), m_thread_count);
+
+  return result;
+}
+
+} // namespace wstinput
+
+/* EOF */
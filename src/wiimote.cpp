@@ -16,6 +16,10 @@
 
 #include "wiimote.hpp"
 
+#include <algorithm>
+#include <assert.h>
+#include <stdio.h>
+
 #include <logmich/log.hpp>
 
 namespace wstinput {
@@ -24,24 +28,14 @@ namespace wstinput {
 
 namespace {
 
-Wiimote* wiimote = nullptr;
+/** Room for about a second of reports from a Wiimote with Nunchuk */
+constexpr size_t g_event_queue_capacity = 1024;
 
 } // namespace
 
-void
-Wiimote::init()
-{
-  wiimote = new Wiimote();
-}
-
-void
-Wiimote::deinit()
-{
-  delete wiimote;
-}
-
-Wiimote::Wiimote()
-  : mutex(),
+Wiimote::Wiimote(int device, std::atomic<uint32_t>& pending)
+  : m_device(device),
+    m_pending(pending),
     m_wiimote(0),
     m_rumble(false),
     m_led_state(0),
@@ -53,20 +47,14 @@ Wiimote::Wiimote()
     wiimote_one(),
     nunchuk_zero(),
     nunchuk_one(),
-    events()
+    m_events(g_event_queue_capacity)
 {
-  pthread_mutex_init(&mutex, NULL);
-
-  assert(wiimote == 0);
-  wiimote = this;
-
-  cwiid_set_err(&Wiimote::err_callback);
+  assert(device >= 0 && device < 32);
 }
 
 Wiimote::~Wiimote()
 {
   disconnect();
-  pthread_mutex_destroy(&mutex);
 }
 
 void
@@ -89,7 +77,11 @@ Wiimote::connect()
   }
   else
   {
-    log_debug("Wiimote connected: {}", m_wiimote);
+    log_debug("Wiimote {} connected: {}", m_device, m_wiimote);
+    if (cwiid_set_data(m_wiimote, this)) {
+      log_error("Unable to set callback data");
+    }
+
     if (cwiid_set_mesg_callback(m_wiimote, &Wiimote::mesg_callback)) {
       log_error("Unable to set message callback");
     }
@@ -206,44 +198,44 @@ Wiimote::set_rumble(bool r)
 }
 
 void
-Wiimote::add_button_event(int /*device*/, int button, bool down)
+Wiimote::add_button_event(int button, bool down)
 {
   WiimoteEvent event;
 
   event.type = WiimoteEvent::WIIMOTE_BUTTON_EVENT;
-  event.button.device = 0;
+  event.button.device = m_device;
   event.button.button = button;
   event.button.down   = down;
 
-  events.push_back(event);
+  m_events.push(event);
 }
 
 void
-Wiimote::add_axis_event(int /*device*/, int axis, float pos)
+Wiimote::add_axis_event(int axis, float pos)
 {
   WiimoteEvent event;
 
   event.type = WiimoteEvent::WIIMOTE_AXIS_EVENT;
-  event.axis.device = 0;
+  event.axis.device = m_device;
   event.axis.axis = axis;
   event.axis.pos  = pos;
 
-  events.push_back(event);
+  m_events.push(event);
 }
 
 void
-Wiimote::add_acc_event(int /*device*/, int accelerometer, float x, float y, float z)
+Wiimote::add_acc_event(int accelerometer, float x, float y, float z)
 {
   WiimoteEvent event;
 
   event.type = WiimoteEvent::WIIMOTE_ACC_EVENT;
-  event.acc.device = 0;
+  event.acc.device = m_device;
   event.acc.accelerometer = accelerometer;
   event.acc.x = x;
   event.acc.y = y;
   event.acc.z = z;
 
-  events.push_back(event);
+  m_events.push(event);
 }
 
 
@@ -290,7 +282,7 @@ Wiimote::on_error(const cwiid_error_mesg& /*msg*/)
 void
 Wiimote::on_button(const cwiid_btn_mesg& msg)
 {
-#define CHECK_BTN(btn, num) if (changes & btn) add_button_event(0, num, m_buttons & btn)
+#define CHECK_BTN(btn, num) if (changes & btn) add_button_event(num, m_buttons & btn)
 
   uint16_t changes = static_cast<uint16_t>(m_buttons ^ msg.buttons);
   m_buttons = msg.buttons;
@@ -316,7 +308,7 @@ Wiimote::on_acc(const cwiid_acc_mesg& msg)
 {
   //printf("Acc Report: x=%d, y=%d, z=%d\n", msg.acc[0], msg.acc[1], msg.acc[2]);
 
-  add_acc_event(0, 0,
+  add_acc_event(0,
                 static_cast<float>(msg.acc[0] - wiimote_zero.x) / static_cast<float>(wiimote_one.x - wiimote_zero.x),
                 static_cast<float>(msg.acc[1] - wiimote_zero.y) / static_cast<float>(wiimote_one.y - wiimote_zero.y),
                 static_cast<float>(msg.acc[2] - wiimote_zero.z) / static_cast<float>(wiimote_one.z - wiimote_zero.z));
@@ -342,11 +334,11 @@ inline float to_float(uint8_t min,
 {
   if (value < center)
   {
-    return math::mid(-1.0f, -static_cast<float>(center - value) / static_cast<float>(center - min), 1.0f);
+    return std::clamp(-static_cast<float>(center - value) / static_cast<float>(center - min), -1.0f, 1.0f);
   }
   else if (value > center)
   {
-    return math::mid(-1.0f, static_cast<float>(value - center) / static_cast<float>(max - center), 1.0f);
+    return std::clamp(static_cast<float>(value - center) / static_cast<float>(max - center), -1.0f, 1.0f);
   }
   else
   {
@@ -360,7 +352,7 @@ Wiimote::on_nunchuck(const cwiid_nunchuk_mesg& msg)
   uint8_t changes = static_cast<uint8_t>(m_nunchuk_btns ^ msg.buttons);
   m_nunchuk_btns  = msg.buttons;
 
-#define CHECK_NCK_BTN(btn, num) if (changes & btn) add_button_event(0, num, m_nunchuk_btns & btn)
+#define CHECK_NCK_BTN(btn, num) if (changes & btn) add_button_event(num, m_nunchuk_btns & btn)
 
   CHECK_NCK_BTN(CWIID_NUNCHUK_BTN_Z, 11);
   CHECK_NCK_BTN(CWIID_NUNCHUK_BTN_C, 12);
@@ -373,16 +365,16 @@ Wiimote::on_nunchuck(const cwiid_nunchuk_mesg& msg)
   if (m_nunchuk_stick_x != nunchuk_stick_x)
   {
     m_nunchuk_stick_x = nunchuk_stick_x;
-    add_axis_event(0, 0, m_nunchuk_stick_x);
+    add_axis_event(WIIMOTE_NUNCHUK_X_AXIS, m_nunchuk_stick_x);
   }
 
   if (m_nunchuk_stick_y != nunchuk_stick_y)
   {
     m_nunchuk_stick_y = nunchuk_stick_y;
-    add_axis_event(0, 1, m_nunchuk_stick_y);
+    add_axis_event(WIIMOTE_NUNCHUK_Y_AXIS, m_nunchuk_stick_y);
   }
 
-  add_acc_event(0, 1,
+  add_acc_event(1,
                 static_cast<float>(msg.acc[0] - nunchuk_zero.x) / static_cast<float>(nunchuk_one.x - nunchuk_zero.x),
                 static_cast<float>(msg.acc[1] - nunchuk_zero.y) / static_cast<float>(nunchuk_one.y - nunchuk_zero.y),
                 static_cast<float>(msg.acc[2] - nunchuk_zero.z) / static_cast<float>(nunchuk_one.z - nunchuk_zero.z));
@@ -405,68 +397,40 @@ Wiimote::on_classic(const cwiid_classic_mesg& msg)
          msg.l, msg.r);
 }
 
-std::vector<WiimoteEvent>
-Wiimote::pop_events()
-{
-  pthread_mutex_lock(&mutex);
-  std::vector<WiimoteEvent> ret = events;
-  events.clear();
-  pthread_mutex_unlock(&mutex);
-  return ret;
-}
-
 // Callback function that get called by the Wiimote thread
-void
-Wiimote::err(cwiid_wiimote_t* w, const char *s, va_list ap)
-{
-  pthread_mutex_lock(&mutex);
-
-  if (w)
-    printf("%d:", cwiid_get_id(w));
-  else
-    printf("-1:");
-
-  vprintf(s, ap);
-  printf("\n");
-
-  pthread_mutex_unlock(&mutex);
-}
-
 void
 Wiimote::mesg(cwiid_wiimote_t* /*w*/, int mesg_count, union cwiid_mesg msg[])
 {
-  pthread_mutex_lock(&mutex);
-
   for (int i=0; i < mesg_count; i++)
   {
     switch (msg[i].type)
     {
       case CWIID_MESG_STATUS:
-        wiimote->on_status(msg[i].status_mesg);
+        on_status(msg[i].status_mesg);
         break;
 
       case CWIID_MESG_BTN:
-        wiimote->on_button(msg[i].btn_mesg);
+        on_button(msg[i].btn_mesg);
         break;
 
       case CWIID_MESG_ACC:
-        wiimote->on_acc(msg[i].acc_mesg);
+        on_acc(msg[i].acc_mesg);
         break;
 
       case CWIID_MESG_IR:
-        wiimote->on_ir(msg[i].ir_mesg);
+        on_ir(msg[i].ir_mesg);
         break;
 
       case CWIID_MESG_NUNCHUK:
-        wiimote->on_nunchuck(msg[i].nunchuk_mesg);
+        on_nunchuck(msg[i].nunchuk_mesg);
         break;
 
       case CWIID_MESG_CLASSIC:
-        wiimote->on_classic(msg[i].classic_mesg);
+        on_classic(msg[i].classic_mesg);
         break;
 
       case CWIID_MESG_ERROR:
-        wiimote->on_error(msg[i].error_mesg);
+        on_error(msg[i].error_mesg);
         break;
 
       default:
@@ -475,7 +439,8 @@ Wiimote::mesg(cwiid_wiimote_t* /*w*/, int mesg_count, union cwiid_mesg msg[])
     }
   }
 
-  pthread_mutex_unlock(&mutex);
+  // wake up WiimoteManager::drain() for this Wiimote
+  m_pending.fetch_or(1u << m_device, std::memory_order_release);
 }
 
 // static callback functions
@@ -483,13 +448,22 @@ Wiimote::mesg(cwiid_wiimote_t* /*w*/, int mesg_count, union cwiid_mesg msg[])
 void
 Wiimote::err_callback(cwiid_wiimote_t* w, const char *s, va_list ap)
 {
-  wiimote->err(w, s, ap);
+  if (w)
+    printf("%d:", cwiid_get_id(w));
+  else
+    printf("-1:");
+
+  vprintf(s, ap);
+  printf("\n");
 }
 
 void
 Wiimote::mesg_callback(cwiid_wiimote_t* w, int mesg_count, union cwiid_mesg mesg[], timespec*)
 {
-  wiimote->mesg(w, mesg_count, mesg);
+  Wiimote* const self = static_cast<Wiimote*>(const_cast<void*>(cwiid_get_data(w)));
+  if (self) {
+    self->mesg(w, mesg_count, mesg);
+  }
 }
 
 #endif // HAVE_CWIID
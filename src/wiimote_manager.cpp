@@ -0,0 +1,116 @@
+// Windstille Input Library
+// Copyright (C) 2005-2020 Ingo Ruhnke <grumbel@gmail.com>
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+// License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "wiimote_manager.hpp"
+
+#include <logmich/log.hpp>
+
+namespace wstinput {
+
+#ifdef HAVE_CWIID
+
+WiimoteManager::WiimoteManager() :
+  m_wiimotes(),
+  m_pending(0)
+{
+  cwiid_set_err(&Wiimote::err_callback);
+}
+
+WiimoteManager::~WiimoteManager()
+{
+  disconnect();
+}
+
+int
+WiimoteManager::connect()
+{
+  for (int device = 0; device < max_wiimotes; ++device)
+  {
+    std::unique_ptr<Wiimote>& wiimote = m_wiimotes[static_cast<size_t>(device)];
+
+    // reuse the slot of a Wiimote that got disconnected on error
+    if (wiimote && wiimote->is_connected()) {
+      continue;
+    }
+
+    if (!wiimote) {
+      wiimote = std::make_unique<Wiimote>(device, m_pending);
+    }
+
+    wiimote->connect();
+    if (!wiimote->is_connected()) {
+      return -1;
+    }
+
+    if (device < 4) {
+      wiimote->set_led(device + 1, true);
+    }
+
+    return device;
+  }
+
+  log_error("WiimoteManager: can't connect more than {} Wiimotes", max_wiimotes);
+  return -1;
+}
+
+void
+WiimoteManager::disconnect()
+{
+  for (std::unique_ptr<Wiimote>& wiimote : m_wiimotes) {
+    wiimote.reset();
+  }
+  m_pending.store(0, std::memory_order_relaxed);
+}
+
+int
+WiimoteManager::get_count() const
+{
+  int count = 0;
+  for (std::unique_ptr<Wiimote> const& wiimote : m_wiimotes) {
+    if (wiimote && wiimote->is_connected()) {
+      count += 1;
+    }
+  }
+  return count;
+}
+
+Wiimote*
+WiimoteManager::get_wiimote(int device) const
+{
+  if (device < 0 || device >= max_wiimotes) {
+    return nullptr;
+  }
+  return m_wiimotes[static_cast<size_t>(device)].get();
+}
+
+uint64_t
+WiimoteManager::get_overflow_count() const
+{
+  uint64_t count = 0;
+  for (std::unique_ptr<Wiimote> const& wiimote : m_wiimotes) {
+    if (wiimote) {
+      count += wiimote->get_overflow_count();
+    }
+  }
+  return count;
+}
+
+#endif // HAVE_CWIID
+
+} // namespace wstinput
+
+/* EOF */
@@ -0,0 +1,242 @@
+// Windstille Input Library
+// Copyright (C) 2005-2020 Ingo Ruhnke <grumbel@gmail.com>
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+// License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+
+// Feeds N frames of synthetic input into a Controller with a
+// preallocated event buffer and fails if any of them allocates
+
+#include <atomic>
+#include <iostream>
+#include <new>
+#include <stdlib.h>
+#include <string.h>
+
+#include <wstinput/controller.hpp>
+
+using namespace wstinput;
+
+namespace {
+
+std::atomic<uint64_t> g_allocations{0};
+
+} // namespace
+
+void* operator new(size_t size)
+{
+  g_allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void* ptr = malloc(size == 0 ? 1 : size)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept
+{
+  free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+  free(ptr);
+}
+
+namespace {
+
+constexpr int g_ids = 16;
+constexpr size_t g_capacity = 64;
+constexpr int g_frames = 1000;
+
+/** Two events per iteration, so this overflows the buffer */
+constexpr int g_events_per_frame = 48;
+
+char const* policy_name(EventOverflowPolicy policy)
+{
+  switch (policy)
+  {
+    case OVERFLOW_DROP_NEWEST: return "drop-newest";
+    case OVERFLOW_DROP_OLDEST: return "drop-oldest";
+    case OVERFLOW_COALESCE: return "coalesce";
+    default: return "unknown";
+  }
+}
+
+void add_frame(Controller& controller, int frame)
+{
+  std::array<char, 32> text{};
+  strcpy(text.data(), "a");
+
+  SDL_KeyboardEvent key{};
+  key.type = SDL_KEYDOWN;
+  key.keysym.scancode = SDL_SCANCODE_A;
+
+  for (int i = 0; i < g_events_per_frame; ++i)
+  {
+    int const id = (frame + i) % g_ids;
+    float const pos = static_cast<float>(i) / g_events_per_frame;
+
+    controller.add_button_event(id, i % 2 == 0);
+    switch (i % 6)
+    {
+      case 0: controller.add_axis_event(id, pos); break;
+      case 1: controller.add_ball_event(id, pos); break;
+      case 2: controller.add_pointer_event(id, pos); break;
+      case 3: controller.add_stick_event(id, pos, -pos); break;
+      case 4: controller.add_text_event(id, text); break;
+      case 5: controller.add_keyboard_event(key); break;
+    }
+  }
+
+  // more payload than fits into the buffer
+  for (size_t i = 0; i < 2 * g_capacity; ++i) {
+    controller.add_keyboard_event(key);
+  }
+}
+
+bool run(EventOverflowPolicy policy)
+{
+  Controller controller(g_ids);
+  controller.set_event_capacity(g_capacity, policy);
+
+  // one frame to let the state settle
+  add_frame(controller, 0);
+  controller.unwrap_events();
+  controller.clear();
+
+  uint64_t const allocations = g_allocations.load(std::memory_order_relaxed);
+
+  float checksum = 0.0f;
+  for (int frame = 1; frame <= g_frames; ++frame)
+  {
+    add_frame(controller, frame);
+    controller.unwrap_events();
+    for (InputEvent const& event : controller.get_events()) {
+      checksum += static_cast<float>(event.type);
+    }
+    controller.clear();
+  }
+
+  uint64_t const allocated = g_allocations.load(std::memory_order_relaxed) - allocations;
+  if (allocated != 0) {
+    std::cerr << policy_name(policy) << ": " << allocated << " allocations in "
+              << g_frames << " frames" << std::endl;
+    return false;
+  }
+
+  if (checksum == 0.0f || controller.get_overflow_count() == 0) {
+    std::cerr << policy_name(policy) << ": no events were processed" << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+/** OVERFLOW_DROP_OLDEST has to keep the newest events in order */
+bool check_drop_oldest()
+{
+  Controller controller(g_ids);
+  controller.set_event_capacity(4, OVERFLOW_DROP_OLDEST);
+
+  for (int i = 0; i < 10; ++i) {
+    controller.add_axis_event(i % g_ids, static_cast<float>(i));
+  }
+
+  controller.unwrap_events();
+  InputEventLst const& events = controller.get_events();
+  if (events.size() != 4) {
+    std::cerr << "drop-oldest: expected 4 events, got " << events.size() << std::endl;
+    return false;
+  }
+
+  for (size_t i = 0; i < events.size(); ++i) {
+    if (events[i].axis.pos != static_cast<float>(6 + i)) {
+      std::cerr << "drop-oldest: event " << i << " out of order" << std::endl;
+      return false;
+    }
+  }
+
+  return true;
+}
+
+/** Overwriting a keyboard or text event has to free its payload, or
+    the newest of them would be dropped once the payload is full */
+bool check_drop_oldest_payload()
+{
+  Controller controller(g_ids);
+  controller.set_event_capacity(4, OVERFLOW_DROP_OLDEST);
+
+  for (int frame = 0; frame < 3; ++frame)
+  {
+    for (int i = 0; i < 10; ++i)
+    {
+      SDL_KeyboardEvent key{};
+      key.type = SDL_KEYDOWN;
+      key.keysym.scancode = static_cast<SDL_Scancode>(SDL_SCANCODE_A + i);
+      controller.add_keyboard_event(key);
+
+      // unwrapping in between must not mix up the payload slots
+      if (i == 6) {
+        controller.unwrap_events();
+      }
+    }
+
+    std::array<char, 32> text{};
+    strcpy(text.data(), "newest");
+    controller.add_text_event(0, text);
+
+    if (controller.get_event_count() != 11) {
+      std::cerr << "drop-oldest: expected 11 added events, got " << controller.get_event_count() << std::endl;
+      return false;
+    }
+
+    controller.unwrap_events();
+    InputEventLst const& events = controller.get_events();
+    if (events.size() != 4) {
+      std::cerr << "drop-oldest: expected 4 events, got " << events.size() << std::endl;
+      return false;
+    }
+
+    for (size_t i = 0; i < 3; ++i) {
+      SDL_Scancode const scancode = controller.get_keyboard_event(events[i]).keysym.scancode;
+      if (scancode != SDL_SCANCODE_A + 7 + static_cast<int>(i)) {
+        std::cerr << "drop-oldest: keyboard event " << i << " has scancode " << scancode << std::endl;
+        return false;
+      }
+    }
+
+    if (controller.get_text(events[3]) != "newest") {
+      std::cerr << "drop-oldest: newest text event was lost" << std::endl;
+      return false;
+    }
+
+    controller.clear();
+  }
+
+  return true;
+}
+
+} // namespace
+
+int main()
+{
+  bool success = check_drop_oldest();
+  success = check_drop_oldest_payload() && success;
+  for (EventOverflowPolicy policy : { OVERFLOW_DROP_NEWEST, OVERFLOW_DROP_OLDEST, OVERFLOW_COALESCE }) {
+    success = run(policy) && success;
+  }
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* EOF */
@@ -0,0 +1,249 @@
+// Windstille Input Library
+// Copyright (C) 2005-2020 Ingo Ruhnke <grumbel@gmail.com>
+//
+// This program is free software: you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or (at your
+// option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+// License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+
+// Records synthetic frames with InputRecorder, plays them back with
+// InputReplay and checks that the events and state come out the same
+
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include <wstinput/controller.hpp>
+#include <wstinput/input_recorder.hpp>
+#include <wstinput/input_replay.hpp>
+
+using namespace wstinput;
+
+namespace {
+
+constexpr int g_ids = 8;
+constexpr int g_frames = 50;
+
+/** Arbitrary fixed start time, so that two recordings are identical */
+constexpr uint64_t g_start_time = 123456789000;
+
+uint64_t get_frame_time(int frame)
+{
+  return g_start_time + static_cast<uint64_t>(frame) * 16666667;
+}
+
+void add_frame(Controller& controller, int frame)
+{
+  float const pos = static_cast<float>(frame % 10) / 10.0f;
+
+  controller.add_button_event(frame % g_ids, frame % 2 == 0);
+  controller.add_axis_event(frame % g_ids, pos);
+  controller.add_ball_event(frame % g_ids, pos);
+  controller.add_pointer_event(frame % g_ids, -pos);
+  controller.add_stick_event(frame % g_ids, pos, -pos);
+
+  std::array<char, 32> text{};
+  std::string const str = "frame" + std::to_string(frame);
+  str.copy(text.data(), text.size());
+  controller.add_text_event(0, text);
+  controller.add_text_edit_event(0, text, frame % 5, 2);
+
+  SDL_KeyboardEvent key{};
+  key.type = SDL_KEYDOWN;
+  key.keysym.scancode = static_cast<SDL_Scancode>(SDL_SCANCODE_A + frame % 26);
+  controller.add_keyboard_event(key);
+}
+
+/** Records g_frames frames and returns the events of each of them */
+std::vector<InputEventLst> record(std::filesystem::path const& filename)
+{
+  std::vector<InputEventLst> frames;
+
+  Controller controller(g_ids);
+  InputRecorder recorder(filename);
+  for (int frame = 0; frame < g_frames; ++frame)
+  {
+    controller.set_timestamp(get_frame_time(frame));
+    add_frame(controller, frame);
+    frames.push_back(controller.get_events());
+    recorder.record_frame(controller);
+    controller.clear();
+  }
+  recorder.flush();
+
+  return frames;
+}
+
+std::string read_file(std::filesystem::path const& filename)
+{
+  std::ifstream in(filename, std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+bool check_round_trip(std::filesystem::path const& filename)
+{
+  std::vector<InputEventLst> const recorded = record(filename);
+
+  Controller expected(g_ids);
+  Controller replayed(g_ids);
+  InputReplay replay(filename);
+  for (int frame = 0; frame < g_frames; ++frame)
+  {
+    if (!replay.replay_frame(replayed)) {
+      std::cerr << "round trip: recording ended after " << frame << " frames" << std::endl;
+      return false;
+    }
+
+    expected.set_timestamp(get_frame_time(frame));
+    add_frame(expected, frame);
+
+    InputEventLst const& events = replayed.get_events();
+    InputEventLst const& original = recorded[static_cast<size_t>(frame)];
+    if (events.size() != original.size()) {
+      std::cerr << "round trip: frame " << frame << " has " << events.size()
+                << " events instead of " << original.size() << std::endl;
+      return false;
+    }
+
+    for (size_t i = 0; i < events.size(); ++i)
+    {
+      if (events[i].type != original[i].type ||
+          events[i].source != original[i].source ||
+          events[i].timestamp != original[i].timestamp ||
+          replayed.get_text(events[i]) != expected.get_text(expected.get_events()[i]) ||
+          replayed.get_keyboard_event(events[i]).keysym.scancode !=
+          expected.get_keyboard_event(expected.get_events()[i]).keysym.scancode)
+      {
+        std::cerr << "round trip: event " << i << " of frame " << frame << " differs" << std::endl;
+        return false;
+      }
+    }
+
+    for (int id = 0; id < g_ids; ++id)
+    {
+      if (replayed.get_button_state(id) != expected.get_button_state(id) ||
+          replayed.get_axis_state(id, false) != expected.get_axis_state(id, false) ||
+          replayed.get_pointer_state(id) != expected.get_pointer_state(id) ||
+          replayed.get_stick_state(id).x != expected.get_stick_state(id).x ||
+          // events carry their time in microseconds
+          replayed.get_change_time(BUTTON_EVENT, id) / 1000 != expected.get_change_time(BUTTON_EVENT, id) / 1000)
+      {
+        std::cerr << "round trip: state of id " << id << " differs after frame " << frame << std::endl;
+        return false;
+      }
+    }
+
+    expected.clear();
+  }
+
+  if (replay.replay_frame(replayed)) {
+    std::cerr << "round trip: more frames than recorded" << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+/** The same input has to give the same file */
+bool check_deterministic(std::filesystem::path const& filename)
+{
+  std::filesystem::path const other = filename.string() + ".2";
+  record(filename);
+  record(other);
+
+  bool const identical = read_file(filename) == read_file(other);
+  std::filesystem::remove(other);
+  if (!identical) {
+    std::cerr << "deterministic: two recordings of the same input differ" << std::endl;
+  }
+  return identical;
+}
+
+/** A payload offset pointing outside of the frame ends the replay */
+bool check_corrupt_payload(std::filesystem::path const& filename)
+{
+  record(filename);
+
+  // point the text event of the second frame far past its payload
+  std::string data = read_file(filename);
+  size_t pos = sizeof(RecordingHeader);
+  RecordingFrameHeader header;
+  memcpy(&header, data.data() + pos, sizeof(header));
+  size_t const frame_data = size_t{header.event_count} * sizeof(InputEvent) + header.payload_size;
+  pos += sizeof(RecordingFrameHeader) +
+    (frame_data + g_recording_alignment - 1) / g_recording_alignment * g_recording_alignment;
+
+  memcpy(&header, data.data() + pos, sizeof(header));
+  for (uint32_t i = 0; i < header.event_count; ++i)
+  {
+    size_t const event_pos = pos + sizeof(RecordingFrameHeader) + i * sizeof(InputEvent);
+    InputEvent event;
+    memcpy(&event, data.data() + event_pos, sizeof(event));
+    if (event.type == TEXT_EVENT) {
+      event.text.offset = 0xfffffff0;
+      memcpy(data.data() + event_pos, &event, sizeof(event));
+    }
+  }
+
+  {
+    std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+    out.write(data.data(), static_cast<std::streamsize>(data.size()));
+  }
+
+  Controller controller(g_ids);
+  InputReplay replay(filename);
+  int frames = 0;
+  try {
+    while (replay.replay_frame(controller)) {
+      frames += 1;
+    }
+  } catch (std::exception const& err) {
+    std::cerr << "corrupt payload: replay threw: " << err.what() << std::endl;
+    return false;
+  }
+
+  if (frames != 1) {
+    std::cerr << "corrupt payload: expected 1 frame, got " << frames << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+} // namespace
+
+int main()
+{
+  std::filesystem::path const filename = std::filesystem::temp_directory_path() /
+    ("wstinput_replay_test." + std::to_string(getpid()) + ".rec");
+
+  bool success = true;
+  try {
+    success = check_round_trip(filename) && success;
+    success = check_deterministic(filename) && success;
+    success = check_corrupt_payload(filename) && success;
+  } catch (std::exception const& err) {
+    std::cerr << "error: " << err.what() << std::endl;
+    success = false;
+  }
+
+  std::filesystem::remove(filename);
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* EOF */